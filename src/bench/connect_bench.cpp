@@ -0,0 +1,147 @@
+/**
+ * 建立连接速率基准测试：多个线程同时对运行中的http_server反复执行
+ * 建立连接、发送一个不保持连接的请求、读取响应直到服务器关闭连接，统计每秒完成的连接数
+ * 用法：connect_bench ip_address port_number [threads] [seconds] [path]
+ *   threads：并发建立连接的线程数，默认64
+ *   seconds：测试时间，默认5
+ *   path：请求的文件，默认/index.html
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <atomic>
+#include <vector>
+#include <algorithm>
+
+static inline uint64_t now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static struct sockaddr_in g_address;
+static char g_request[256];
+static int g_request_len = 0;
+static std::atomic<bool> g_stop(false);
+
+struct client_stat
+{
+    long connections;
+    long errors;
+    std::vector<uint32_t> latency_us;   // 从connect到读完响应
+};
+
+/**
+ * 完成一次连接：connect、发送请求、读到对方关闭
+*/
+static bool one_connection()
+{
+    int fd = socket(PF_INET, SOCK_STREAM, 0);
+    if (fd < 0)
+    {
+        return false;
+    }
+    // 客户端主动RST关闭，不占用TIME_WAIT和本地端口
+    struct linger tmp = { 1, 0 };
+    setsockopt(fd, SOL_SOCKET, SO_LINGER, &tmp, sizeof(tmp));
+    // 服务器漏掉的连接在超时后计为错误
+    struct timeval tv = { 1, 0 };
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    bool ok = false;
+    if (connect(fd, (struct sockaddr*)&g_address, sizeof(g_address)) == 0
+        && send(fd, g_request, g_request_len, 0) == g_request_len)
+    {
+        char buf[4096];
+        long total = 0;
+        ssize_t n = 0;
+        while ((n = recv(fd, buf, sizeof(buf), 0)) > 0)
+        {
+            total += n;
+        }
+        ok = (n == 0 && total > 0);
+    }
+    close(fd);
+    return ok;
+}
+
+static void* client(void* arg)
+{
+    client_stat* stat = (client_stat*)arg;
+    while (!g_stop.load(std::memory_order_relaxed))
+    {
+        uint64_t begin = now_ns();
+        if (one_connection())
+        {
+            ++stat->connections;
+            stat->latency_us.push_back((uint32_t)((now_ns() - begin) / 1000));
+        }
+        else
+        {
+            ++stat->errors;
+        }
+    }
+    return stat;
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc < 3)
+    {
+        printf("usage: %s ip_address port_number [threads] [seconds] [path]\n", argv[0]);
+        return 1;
+    }
+    int threads = argc > 3 ? atoi(argv[3]) : 64;
+    int seconds = argc > 4 ? atoi(argv[4]) : 5;
+    const char* path = argc > 5 ? argv[5] : "/index.html";
+    if (threads <= 0 || seconds <= 0)
+    {
+        printf("usage: %s ip_address port_number [threads] [seconds] [path]\n", argv[0]);
+        return 1;
+    }
+
+    memset(&g_address, 0, sizeof(g_address));
+    g_address.sin_family = AF_INET;
+    inet_pton(AF_INET, argv[1], &g_address.sin_addr);
+    g_address.sin_port = htons(atoi(argv[2]));
+    g_request_len = snprintf(g_request, sizeof(g_request), "GET %s HTTP/1.1\r\nHost: %s\r\n\r\n", path, argv[1]);
+
+    std::vector<client_stat> stats(threads);
+    std::vector<pthread_t> tids(threads);
+    uint64_t begin = now_ns();
+    for (int i = 0; i < threads; ++i)
+    {
+        stats[i].connections = 0;
+        stats[i].errors = 0;
+        pthread_create(&tids[i], NULL, client, &stats[i]);
+    }
+    sleep(seconds);
+    g_stop.store(true);
+    long connections = 0;
+    long errors = 0;
+    std::vector<uint32_t> lat;
+    for (int i = 0; i < threads; ++i)
+    {
+        pthread_join(tids[i], NULL);
+        connections += stats[i].connections;
+        errors += stats[i].errors;
+        lat.insert(lat.end(), stats[i].latency_us.begin(), stats[i].latency_us.end());
+    }
+    uint64_t elapsed = now_ns() - begin;
+    std::sort(lat.begin(), lat.end());
+    size_t n = lat.size();
+    printf("{\"threads\":%d,\"connections\":%ld,\"errors\":%ld,\"conn_per_sec\":%.0f,"
+           "\"p50_us\":%u,\"p99_us\":%u,\"p999_us\":%u}\n",
+           threads, connections, errors, connections * 1e9 / elapsed,
+           n ? lat[n / 2] : 0, n ? lat[n * 99 / 100] : 0, n ? lat[n * 999 / 1000] : 0);
+    return 0;
+}
@@ -0,0 +1,126 @@
+/**
+ * 请求阶段延迟统计的开销和精度基准测试
+ *   record：每次记录的CPU耗时（一次时钟读取加一次直方图记录），与只读时钟比较，1到8个线程同时记录
+ *   merge：合并各线程直方图的耗时
+ *   accuracy：对数正态分布样本上直方图百分位数与精确值的相对误差
+ * 用法：latency_bench [records_per_thread]
+ *   records_per_thread：每个线程记录的次数，默认10000000
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <math.h>
+#include <pthread.h>
+#include <vector>
+#include <random>
+#include <algorithm>
+
+#include "../latency_stats.h"
+
+static long g_records = 10000000;
+
+/**
+ * 线程的CPU时间，线程数超过CPU数时也能得到每次操作的开销
+*/
+static uint64_t thread_cpu_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+struct thread_result
+{
+    bool record;
+    uint64_t sink;
+    double ns_per_op;
+};
+
+static void* worker(void* arg)
+{
+    thread_result* r = (thread_result*)arg;
+    uint64_t begin = thread_cpu_ns();
+    uint64_t last = latency_stats::now();
+    for (long i = 0; i < g_records; ++i)
+    {
+        uint64_t now = latency_stats::now();
+        if (r->record)
+        {
+            latency_stats::record(latency_stats::PARSE, now - last);
+        }
+        r->sink += now - last;
+        last = now;
+    }
+    r->ns_per_op = (double)(thread_cpu_ns() - begin) / g_records;
+    return r;
+}
+
+static double run(int threads, bool record)
+{
+    std::vector<pthread_t> tids(threads);
+    std::vector<thread_result> results(threads);
+    for (int i = 0; i < threads; ++i)
+    {
+        results[i].record = record;
+        results[i].sink = 0;
+        pthread_create(&tids[i], NULL, worker, &results[i]);
+    }
+    double total = 0;
+    for (int i = 0; i < threads; ++i)
+    {
+        pthread_join(tids[i], NULL);
+        total += results[i].ns_per_op;
+    }
+    return total / threads;
+}
+
+int main(int argc, char* argv[])
+{
+    g_records = argc > 1 ? atol(argv[1]) : 10000000;
+    if (g_records <= 0)
+    {
+        printf("usage: %s [records_per_thread]\n", argv[0]);
+        return 1;
+    }
+
+    int thread_counts[] = { 1, 2, 4, 8 };
+    for (size_t i = 0; i < sizeof(thread_counts) / sizeof(thread_counts[0]); ++i)
+    {
+        int threads = thread_counts[i];
+        double clock_ns = run(threads, false);
+        double record_ns = run(threads, true);
+        printf("{\"test\":\"record\",\"threads\":%d,\"clock_ns\":%.2f,\"clock_record_ns\":%.2f,\"record_ns\":%.2f}\n",
+               threads, clock_ns, record_ns, record_ns - clock_ns);
+        fflush(stdout);
+    }
+
+    // 此时已注册了1+2+4+8个线程的直方图
+    int rounds = 100;
+    uint64_t begin = latency_stats::now();
+    for (int i = 0; i < rounds; ++i)
+    {
+        latency_stats::instance()->merge();
+    }
+    printf("{\"test\":\"merge\",\"shards\":15,\"merge_us\":%.1f}\n", (latency_stats::now() - begin) / 1e3 / rounds);
+
+    // 精度：中位数10us、长尾到数十毫秒的对数正态分布
+    std::mt19937_64 rng(1);
+    std::lognormal_distribution<double> dist(log(10000.0), 1.5);
+    std::vector<uint64_t> samples(1000000);
+    static hdr_histogram h;
+    for (size_t i = 0; i < samples.size(); ++i)
+    {
+        samples[i] = (uint64_t)dist(rng);
+        h.record(samples[i]);
+    }
+    std::sort(samples.begin(), samples.end());
+    double ps[] = { 50, 90, 99, 99.9 };
+    for (size_t i = 0; i < sizeof(ps) / sizeof(ps[0]); ++i)
+    {
+        uint64_t exact = samples[(size_t)(ps[i] / 100 * samples.size() + 0.5) - 1];
+        uint64_t approx = h.percentile(ps[i]);
+        printf("{\"test\":\"accuracy\",\"percentile\":%g,\"exact_ns\":%llu,\"histogram_ns\":%llu,\"relative_error\":%.4f}\n",
+               ps[i], (unsigned long long)exact, (unsigned long long)approx, ((double)approx - exact) / exact);
+    }
+    return 0;
+}
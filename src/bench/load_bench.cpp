@@ -0,0 +1,634 @@
+/**
+ * HTTP负载生成器：基于libevent，每个线程一个event_base，对运行中的http_server发送请求，
+ * 统计完成的请求数和延迟分布，输出一行JSON
+ *   闭环模式（默认）：每个连接始终保持depth个未完成的请求，收到一个响应立即发送下一个
+ *   开环模式（-r）：按固定速率产生请求，交给有空闲的连接发送，延迟从计划发送时刻开始计算，
+ *   服务器变慢时排队的时间也计入延迟
+ * 用法：load_bench [-c connections] [-t threads] [-p depth] [-k 0|1|2] [-s seconds] [-w warmup]
+ *                  [-r rate] [-m path[:weight],...] [-l label] ip_address port_number
+ *   -c：连接数，默认64
+ *   -t：线程数，默认1
+ *   -p：每个连接的流水线深度，默认1，不保持连接时固定为1
+ *   -k：是否保持连接，默认1；为0时每个请求使用一个新连接；为2时保持连接但不发送Connection头部，
+ *       与wrk、h2load等工具的请求相同
+ *   -s：测量时间（秒），默认5
+ *   -w：预热时间（秒），不计入结果，默认1
+ *   -r：开环模式的总请求速率（每秒），默认0即闭环模式
+ *   -m：请求的文件及权重，默认/index.html
+ *   -l：输出中的标签，便于脚本区分不同场景
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <errno.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <event.h>
+#include <string>
+#include <vector>
+#include <deque>
+#include <algorithm>
+
+static inline uint64_t now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+/**** 测试参数 ****/
+static struct sockaddr_in g_address;
+static int g_connections = 64;
+static int g_threads = 1;
+static int g_depth = 1;
+static bool g_keepalive = true;
+static bool g_connection_header = true;    // 请求是否带Connection头部，不带时依赖HTTP/1.1默认保持连接
+static int g_seconds = 5;
+static int g_warmup = 1;
+static double g_rate = 0;
+static const char* g_label = "";
+static const uint64_t TICK_NS = 1000000;    // 开环模式产生请求的间隔
+
+/**
+ * 请求组合中的一种请求
+*/
+struct request_type
+{
+    std::string path;
+    int weight;
+    std::string text;   // 完整的请求报文
+};
+static std::vector<request_type> g_requests;
+static int g_total_weight = 0;
+
+struct bench_thread;
+
+/**
+ * 一个客户连接
+*/
+struct bench_conn
+{
+    bench_thread* thread;
+    int fd;
+    unsigned serial;    // 每次建立连接加一，回调中用来判断连接是否已被替换
+    bool connecting;    // 非阻塞connect尚未完成
+    struct event* read_ev;
+    struct event* write_ev;
+    std::string out;    // 尚未发送完的请求
+    size_t out_offset;
+    std::deque<uint64_t> inflight;  // 已发送请求的计时起点，按发送顺序
+    // 响应解析状态
+    std::string header;
+    bool in_body;
+    long body_left;
+    int status;
+    bool server_close;  // 响应带有Connection: close
+};
+
+/**
+ * 一个负载线程，独占一个event_base
+*/
+struct bench_thread
+{
+    pthread_t tid;
+    struct event_base* base;
+    std::vector<bench_conn> conns;
+    unsigned seed;
+    bool recording;     // 预热结束后开始统计
+    bool stopping;
+    uint64_t window_begin;
+    uint64_t window_end;
+    // 开环模式
+    struct event* tick_ev;
+    double rate;        // 本线程每纳秒的请求数
+    uint64_t schedule_begin;
+    long scheduled;
+    std::deque<uint64_t> backlog;   // 已到计划时刻、等待空闲连接的请求
+    size_t next_conn;   // 轮流分配请求的起始连接
+    // 统计
+    long requests;
+    long errors;
+    long non_2xx;
+    long long bytes;
+    std::vector<uint32_t> latency_us;
+};
+
+static void conn_open(bench_conn* c);
+static void conn_flush(bench_conn* c);
+
+static void conn_close(bench_conn* c)
+{
+    bench_thread* t = c->thread;
+    if (t->recording)
+    {
+        t->errors += c->inflight.size();
+    }
+    c->inflight.clear();
+    event_del(c->read_ev);
+    event_del(c->write_ev);
+    close(c->fd);
+    c->fd = -1;
+}
+
+static void conn_reopen(bench_conn* c)
+{
+    conn_close(c);
+    if (!c->thread->stopping)
+    {
+        conn_open(c);
+    }
+}
+
+/**
+ * 按权重随机选择一个请求放入发送缓冲
+*/
+static void conn_send(bench_conn* c, uint64_t begin)
+{
+    int r = rand_r(&c->thread->seed) % g_total_weight;
+    size_t i = 0;
+    while (r >= g_requests[i].weight)
+    {
+        r -= g_requests[i].weight;
+        ++i;
+    }
+    c->out.append(g_requests[i].text);
+    c->inflight.push_back(begin);
+}
+
+/**
+ * 补足连接上未完成的请求
+*/
+static void conn_refill(bench_conn* c)
+{
+    bench_thread* t = c->thread;
+    if (t->stopping || c->fd == -1)
+    {
+        return;
+    }
+    size_t depth = g_keepalive ? g_depth : 1;
+    if (!g_keepalive && (c->inflight.size() > 0 || c->header.size() > 0 || c->in_body))
+    {
+        return;     // 不保持连接时一个连接只发送一个请求
+    }
+    if (g_rate > 0)
+    {
+        while (c->inflight.size() < depth && !t->backlog.empty())
+        {
+            conn_send(c, t->backlog.front());
+            t->backlog.pop_front();
+        }
+    }
+    else
+    {
+        uint64_t now = now_ns();
+        while (c->inflight.size() < depth)
+        {
+            conn_send(c, now);
+        }
+    }
+    conn_flush(c);
+}
+
+static void conn_flush(bench_conn* c)
+{
+    if (c->connecting)
+    {
+        return;
+    }
+    while (c->out_offset < c->out.size())
+    {
+        ssize_t n = send(c->fd, c->out.data() + c->out_offset, c->out.size() - c->out_offset, MSG_NOSIGNAL);
+        if (n < 0)
+        {
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+            {
+                event_add(c->write_ev, NULL);
+                return;
+            }
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            conn_reopen(c);
+            return;
+        }
+        c->out_offset += n;
+    }
+    c->out.clear();
+    c->out_offset = 0;
+    event_del(c->write_ev);
+}
+
+/**
+ * 一个完整的响应接收完毕
+*/
+static void response_done(bench_conn* c)
+{
+    bench_thread* t = c->thread;
+    uint64_t begin = c->inflight.front();
+    c->inflight.pop_front();
+    if (t->recording)
+    {
+        ++t->requests;
+        if (c->status < 200 || c->status >= 300)
+        {
+            ++t->non_2xx;
+        }
+        t->latency_us.push_back((uint32_t)((now_ns() - begin) / 1000));
+    }
+    c->header.clear();
+    c->in_body = false;
+    if (!g_keepalive || c->server_close)
+    {
+        conn_reopen(c);
+    }
+    else
+    {
+        conn_refill(c);
+    }
+}
+
+/**
+ * 解析收到的响应数据，响应体只计数不保存
+*/
+static void conn_parse(bench_conn* c, const char* data, size_t len)
+{
+    unsigned serial = c->serial;
+    while (len > 0 && c->serial == serial && c->fd != -1)
+    {
+        if (c->in_body)
+        {
+            size_t n = std::min((size_t)c->body_left, len);
+            c->body_left -= n;
+            data += n;
+            len -= n;
+            if (c->body_left == 0)
+            {
+                response_done(c);
+            }
+            continue;
+        }
+        size_t old_size = c->header.size();
+        c->header.append(data, len);
+        size_t end = c->header.find("\r\n\r\n", old_size > 3 ? old_size - 3 : 0);
+        if (end == std::string::npos)
+        {
+            return;
+        }
+        end += 4;
+        data += end - old_size;
+        len -= end - old_size;
+        c->header.resize(end);
+
+        const char* h = c->header.c_str();
+        c->status = (strncmp(h, "HTTP/1.", 7) == 0) ? atoi(h + 9) : 0;
+        const char* cl = strcasestr(h, "\r\nContent-Length:");
+        c->body_left = cl ? atol(cl + 17) : 0;
+        c->server_close = (strcasestr(h, "\r\nConnection: close") != NULL);
+        c->in_body = true;
+        if (c->body_left == 0)
+        {
+            response_done(c);
+        }
+    }
+}
+
+static void read_cb(int fd, short events, void* arg)
+{
+    bench_conn* c = (bench_conn*)arg;
+    char buf[65536];
+    unsigned serial = c->serial;
+    while (c->serial == serial && c->fd != -1)
+    {
+        ssize_t n = recv(fd, buf, sizeof(buf), 0);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            if (errno != EAGAIN && errno != EWOULDBLOCK)
+            {
+                conn_reopen(c);
+            }
+            return;
+        }
+        if (n == 0)
+        {
+            // 对方关闭连接，未完成的请求计为错误
+            conn_reopen(c);
+            return;
+        }
+        if (c->thread->recording)
+        {
+            c->thread->bytes += n;
+        }
+        conn_parse(c, buf, n);
+    }
+}
+
+static void write_cb(int fd, short events, void* arg)
+{
+    bench_conn* c = (bench_conn*)arg;
+    if (c->connecting)
+    {
+        int error = 0;
+        socklen_t len = sizeof(error);
+        getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &len);
+        if (error != 0)
+        {
+            conn_reopen(c);
+            return;
+        }
+        c->connecting = false;
+    }
+    conn_flush(c);
+}
+
+static void conn_open(bench_conn* c)
+{
+    bench_thread* t = c->thread;
+    c->out.clear();
+    c->out_offset = 0;
+    c->header.clear();
+    c->in_body = false;
+    ++c->serial;
+    c->fd = socket(PF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+    if (c->fd < 0)
+    {
+        return;
+    }
+    int on = 1;
+    setsockopt(c->fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+    // 客户端主动RST关闭，不占用TIME_WAIT和本地端口
+    struct linger tmp = { 1, 0 };
+    setsockopt(c->fd, SOL_SOCKET, SO_LINGER, &tmp, sizeof(tmp));
+    c->connecting = false;
+    if (connect(c->fd, (struct sockaddr*)&g_address, sizeof(g_address)) < 0)
+    {
+        if (errno != EINPROGRESS)
+        {
+            if (t->recording)
+            {
+                ++t->errors;
+            }
+            close(c->fd);
+            c->fd = -1;
+            return;
+        }
+        c->connecting = true;
+    }
+    event_assign(c->read_ev, t->base, c->fd, EV_READ | EV_PERSIST, read_cb, c);
+    event_assign(c->write_ev, t->base, c->fd, EV_WRITE | EV_PERSIST, write_cb, c);
+    event_add(c->read_ev, NULL);
+    if (c->connecting)
+    {
+        event_add(c->write_ev, NULL);
+    }
+    conn_refill(c);
+}
+
+/**
+ * 开环模式每毫秒产生到期的请求，分配给有空闲的连接
+*/
+static void tick_cb(int fd, short events, void* arg)
+{
+    bench_thread* t = (bench_thread*)arg;
+    uint64_t now = now_ns();
+    long due = (long)((now - t->schedule_begin) * t->rate);
+    while (t->scheduled < due)
+    {
+        // 请求按tick成批产生，落后不到一个tick的按当前时刻计时，不把tick的粒度算作延迟；
+        // 事件循环本身落后更多时按计划时刻计时
+        uint64_t planned = t->schedule_begin + (uint64_t)(t->scheduled / t->rate);
+        t->backlog.push_back(now - planned < TICK_NS ? now : planned);
+        ++t->scheduled;
+    }
+    size_t n = t->conns.size();
+    for (size_t i = 0; i < n && !t->backlog.empty(); ++i)
+    {
+        bench_conn* c = &t->conns[(t->next_conn + i) % n];
+        if (c->fd == -1)
+        {
+            conn_open(c);
+        }
+        else
+        {
+            conn_refill(c);
+        }
+    }
+    t->next_conn = (t->next_conn + 1) % n;
+}
+
+static void warmup_cb(int fd, short events, void* arg)
+{
+    bench_thread* t = (bench_thread*)arg;
+    t->recording = true;
+    t->window_begin = now_ns();
+}
+
+static void stop_cb(int fd, short events, void* arg)
+{
+    bench_thread* t = (bench_thread*)arg;
+    t->window_end = now_ns();
+    t->recording = false;
+    t->stopping = true;
+    event_base_loopbreak(t->base);
+}
+
+static void* worker(void* arg)
+{
+    bench_thread* t = (bench_thread*)arg;
+    t->schedule_begin = now_ns();
+    for (size_t i = 0; i < t->conns.size(); ++i)
+    {
+        conn_open(&t->conns[i]);
+    }
+    struct timeval warmup = { g_warmup, 0 };
+    struct timeval stop = { g_warmup + g_seconds, 0 };
+    event_base_once(t->base, -1, EV_TIMEOUT, warmup_cb, t, &warmup);
+    event_base_once(t->base, -1, EV_TIMEOUT, stop_cb, t, &stop);
+    if (g_rate > 0)
+    {
+        struct timeval tick = { 0, (long)(TICK_NS / 1000) };
+        t->tick_ev = event_new(t->base, -1, EV_PERSIST, tick_cb, t);
+        event_add(t->tick_ev, &tick);
+    }
+    event_base_dispatch(t->base);
+    for (size_t i = 0; i < t->conns.size(); ++i)
+    {
+        if (t->conns[i].fd != -1)
+        {
+            conn_close(&t->conns[i]);
+        }
+    }
+    return t;
+}
+
+/**
+ * 解析请求组合，格式为path[:weight],...
+*/
+static bool parse_mix(const char* mix, const char* host)
+{
+    std::string s(mix);
+    size_t pos = 0;
+    while (pos <= s.size())
+    {
+        size_t comma = s.find(',', pos);
+        std::string item = s.substr(pos, comma == std::string::npos ? std::string::npos : comma - pos);
+        pos = (comma == std::string::npos) ? s.size() + 1 : comma + 1;
+        if (item.empty())
+        {
+            continue;
+        }
+        request_type req;
+        size_t colon = item.find(':');
+        req.path = item.substr(0, colon);
+        req.weight = (colon == std::string::npos) ? 1 : atoi(item.c_str() + colon + 1);
+        if (req.path.empty() || req.path[0] != '/' || req.weight <= 0)
+        {
+            return false;
+        }
+        req.text = "GET " + req.path + " HTTP/1.1\r\nHost: " + host + "\r\n";
+        if (g_connection_header)
+        {
+            req.text += std::string("Connection: ") + (g_keepalive ? "keep-alive" : "close") + "\r\n";
+        }
+        req.text += "\r\n";
+        g_total_weight += req.weight;
+        g_requests.push_back(req);
+    }
+    return !g_requests.empty();
+}
+
+int main(int argc, char* argv[])
+{
+    int opt;
+    const char* mix = "/index.html";
+    while ((opt = getopt(argc, argv, "c:t:p:k:s:w:r:m:l:")) != -1)
+    {
+        switch (opt)
+        {
+            case 'c':
+                g_connections = atoi(optarg);
+                break;
+            case 't':
+                g_threads = atoi(optarg);
+                break;
+            case 'p':
+                g_depth = atoi(optarg);
+                break;
+            case 'k':
+                g_keepalive = atoi(optarg) != 0;
+                g_connection_header = atoi(optarg) != 2;
+                break;
+            case 's':
+                g_seconds = atoi(optarg);
+                break;
+            case 'w':
+                g_warmup = atoi(optarg);
+                break;
+            case 'r':
+                g_rate = atof(optarg);
+                break;
+            case 'm':
+                mix = optarg;
+                break;
+            case 'l':
+                g_label = optarg;
+                break;
+            default:
+                break;
+        }
+    }
+    if (argc - optind < 2 || g_threads <= 0 || g_connections < g_threads || g_depth <= 0
+        || g_seconds <= 0 || g_warmup < 0 || g_rate < 0 || !parse_mix(mix, argv[optind]))
+    {
+        printf("usage: %s [-c connections] [-t threads] [-p depth] [-k 0|1|2] [-s seconds] [-w warmup] "
+               "[-r rate] [-m path[:weight],...] [-l label] ip_address port_number\n", argv[0]);
+        return 1;
+    }
+    memset(&g_address, 0, sizeof(g_address));
+    g_address.sin_family = AF_INET;
+    inet_pton(AF_INET, argv[optind], &g_address.sin_addr);
+    g_address.sin_port = htons(atoi(argv[optind + 1]));
+
+    // 连接平均分配到各线程
+    std::vector<bench_thread> threads(g_threads);
+    for (int i = 0; i < g_threads; ++i)
+    {
+        bench_thread* t = &threads[i];
+        t->base = event_base_new();
+        t->conns.resize(g_connections / g_threads + (i < g_connections % g_threads ? 1 : 0));
+        for (size_t j = 0; j < t->conns.size(); ++j)
+        {
+            bench_conn* c = &t->conns[j];
+            c->thread = t;
+            c->fd = -1;
+            c->serial = 0;
+            c->read_ev = event_new(t->base, -1, 0, read_cb, c);
+            c->write_ev = event_new(t->base, -1, 0, write_cb, c);
+        }
+        t->seed = i + 1;
+        t->recording = false;
+        t->stopping = false;
+        t->window_begin = t->window_end = 0;
+        t->tick_ev = NULL;
+        t->rate = g_rate / g_threads / 1e9;
+        t->scheduled = 0;
+        t->next_conn = 0;
+        t->requests = t->errors = t->non_2xx = 0;
+        t->bytes = 0;
+    }
+    for (int i = 0; i < g_threads; ++i)
+    {
+        pthread_create(&threads[i].tid, NULL, worker, &threads[i]);
+    }
+
+    long requests = 0;
+    long errors = 0;
+    long non_2xx = 0;
+    long long bytes = 0;
+    double req_per_sec = 0;
+    double mb_per_sec = 0;
+    std::vector<uint32_t> lat;
+    for (int i = 0; i < g_threads; ++i)
+    {
+        bench_thread* t = &threads[i];
+        pthread_join(t->tid, NULL);
+        double window = (t->window_end - t->window_begin) / 1e9;
+        requests += t->requests;
+        errors += t->errors;
+        non_2xx += t->non_2xx;
+        bytes += t->bytes;
+        req_per_sec += t->requests / window;
+        mb_per_sec += t->bytes / window / (1024 * 1024);
+        lat.insert(lat.end(), t->latency_us.begin(), t->latency_us.end());
+        for (size_t j = 0; j < t->conns.size(); ++j)
+        {
+            event_free(t->conns[j].read_ev);
+            event_free(t->conns[j].write_ev);
+        }
+        if (t->tick_ev != NULL)
+        {
+            event_free(t->tick_ev);
+        }
+        event_base_free(t->base);
+    }
+    std::sort(lat.begin(), lat.end());
+    size_t n = lat.size();
+    printf("{\"label\":\"%s\",\"mode\":\"%s\",\"threads\":%d,\"connections\":%d,\"depth\":%d,\"keepalive\":%d,"
+           "\"rate\":%.0f,\"seconds\":%d,\"requests\":%ld,\"errors\":%ld,\"non_2xx\":%ld,"
+           "\"req_per_sec\":%.0f,\"mb_per_sec\":%.1f,\"p50_us\":%u,\"p99_us\":%u,\"p999_us\":%u,\"max_us\":%u}\n",
+           g_label, g_rate > 0 ? "open" : "closed", g_threads, g_connections, g_keepalive ? g_depth : 1,
+           g_keepalive ? (g_connection_header ? 1 : 2) : 0, g_rate, g_seconds, requests, errors, non_2xx, req_per_sec, mb_per_sec,
+           n ? lat[n / 2] : 0, n ? lat[n * 99 / 100] : 0, n ? lat[n * 999 / 1000] : 0, n ? lat[n - 1] : 0);
+    return 0;
+}
@@ -0,0 +1,123 @@
+/**
+ * 异步日志的开销基准测试，每个线程写一条带字符串和整数参数的日志
+ *   disabled：低于当前级别的日志
+ *   async：写入本线程缓冲区，由后台线程格式化输出到/dev/null
+ *   fprintf：原来的做法，在调用线程格式化并写入共享的stdio流
+ * 每个线程每写BURST条日志休眠一段时间，让后台线程清空缓冲区，休眠不计入线程CPU时间
+ * 用法：log_bench [logs_per_thread]
+ *   logs_per_thread：每个线程写的日志条数，默认50000
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+#include <pthread.h>
+#include <vector>
+
+#include "../logger.h"
+
+static const int BURST = 500;
+static long g_logs = 50000;
+static FILE* g_devnull = nullptr;
+
+enum MODE { DISABLED, ASYNC, FPRINTF };
+static const char* mode_names[] = { "disabled", "async", "fprintf" };
+
+static uint64_t thread_cpu_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+struct thread_result
+{
+    MODE mode;
+    double ns_per_log;
+};
+
+static void* worker(void* arg)
+{
+    thread_result* r = (thread_result*)arg;
+    const char* line = "Host: 127.0.0.1:9190";
+    struct timespec pause = { 0, 20 * 1000 * 1000 };
+    uint64_t cpu = 0;
+    for (long done = 0; done < g_logs; done += BURST)
+    {
+        uint64_t begin = thread_cpu_ns();
+        for (int i = 0; i < BURST; ++i)
+        {
+            switch (r->mode)
+            {
+                case DISABLED:
+                    LOG_DEBUG("got 1 http line: %s", line);
+                    break;
+                case ASYNC:
+                    LOG_INFO("got 1 http line: %s (%d)", line, i);
+                    break;
+                case FPRINTF:
+                    fprintf(g_devnull, "got 1 http line: %s (%d)\n", line, i);
+                    break;
+            }
+        }
+        cpu += thread_cpu_ns() - begin;
+        if (r->mode != DISABLED)
+        {
+            nanosleep(&pause, nullptr);
+        }
+    }
+    r->ns_per_log = (double)cpu / g_logs;
+    return r;
+}
+
+static double run(int threads, MODE mode)
+{
+    std::vector<pthread_t> tids(threads);
+    std::vector<thread_result> results(threads);
+    for (int i = 0; i < threads; ++i)
+    {
+        results[i].mode = mode;
+        pthread_create(&tids[i], NULL, worker, &results[i]);
+    }
+    double total = 0;
+    for (int i = 0; i < threads; ++i)
+    {
+        pthread_join(tids[i], NULL);
+        total += results[i].ns_per_log;
+    }
+    return total / threads;
+}
+
+int main(int argc, char* argv[])
+{
+    g_logs = argc > 1 ? atol(argv[1]) : 50000;
+    if (g_logs <= 0)
+    {
+        printf("usage: %s [logs_per_thread]\n", argv[0]);
+        return 1;
+    }
+    g_devnull = fopen("/dev/null", "w");
+    if (!g_devnull || !logger::instance()->init("/dev/null"))
+    {
+        printf("cannot open /dev/null\n");
+        return 1;
+    }
+    logger::set_level(logger::LEVEL_INFO);
+
+    int thread_counts[] = { 1, 4 };
+    for (size_t i = 0; i < sizeof(thread_counts) / sizeof(thread_counts[0]); ++i)
+    {
+        for (int mode = DISABLED; mode <= FPRINTF; ++mode)
+        {
+            uint64_t dropped = logger::instance()->dropped();
+            double ns = run(thread_counts[i], (MODE)mode);
+            printf("{\"mode\":\"%s\",\"threads\":%d,\"logs_per_thread\":%ld,\"ns_per_log\":%.1f,\"dropped\":%llu}\n",
+                   mode_names[mode], thread_counts[i], g_logs, ns,
+                   (unsigned long long)(logger::instance()->dropped() - dropped));
+            fflush(stdout);
+        }
+    }
+    logger::instance()->stop();
+    fclose(g_devnull);
+    return 0;
+}
@@ -0,0 +1,181 @@
+/**
+ * 请求头部扫描基准测试
+ * 使用真实浏览器发出的请求头部作为语料，比较原先的逐字节扫描+strncasecmp链
+ * 与标量、SSE4.2、AVX2查找及完美哈希头部查找的吞吐量，结果以JSON行输出
+*/
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <strings.h>
+#include <time.h>
+#include <string>
+#include <vector>
+#include "../http_scan.h"
+
+static const char* corpus[] =
+{
+    // Chrome
+    "GET /index.html HTTP/1.1\r\n"
+    "Host: 192.168.1.10:9190\r\n"
+    "Connection: keep-alive\r\n"
+    "Cache-Control: max-age=0\r\n"
+    "sec-ch-ua: \"Chromium\";v=\"118\", \"Google Chrome\";v=\"118\", \"Not=A?Brand\";v=\"99\"\r\n"
+    "sec-ch-ua-mobile: ?0\r\n"
+    "sec-ch-ua-platform: \"Windows\"\r\n"
+    "Upgrade-Insecure-Requests: 1\r\n"
+    "User-Agent: Mozilla/5.0 (Windows NT 10.0; Win64; x64) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/118.0.0.0 Safari/537.36\r\n"
+    "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,image/avif,image/webp,image/apng,*/*;q=0.8,application/signed-exchange;v=b3;q=0.7\r\n"
+    "Sec-Fetch-Site: none\r\n"
+    "Sec-Fetch-Mode: navigate\r\n"
+    "Sec-Fetch-User: ?1\r\n"
+    "Sec-Fetch-Dest: document\r\n"
+    "Accept-Encoding: gzip, deflate, br\r\n"
+    "Accept-Language: zh-CN,zh;q=0.9,en;q=0.8\r\n"
+    "Cookie: _ga=GA1.1.1234567890.1697000000; session=3f2a9c0d8e7b6a5f4e3d2c1b0a998877; theme=dark\r\n"
+    "\r\n",
+    // Firefox
+    "GET /small.bin HTTP/1.1\r\n"
+    "Host: 192.168.1.10:9190\r\n"
+    "User-Agent: Mozilla/5.0 (X11; Linux x86_64; rv:109.0) Gecko/20100101 Firefox/118.0\r\n"
+    "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,image/avif,image/webp,*/*;q=0.8\r\n"
+    "Accept-Language: en-US,en;q=0.5\r\n"
+    "Accept-Encoding: gzip, deflate\r\n"
+    "DNT: 1\r\n"
+    "Connection: keep-alive\r\n"
+    "Upgrade-Insecure-Requests: 1\r\n"
+    "Sec-Fetch-Dest: document\r\n"
+    "Sec-Fetch-Mode: navigate\r\n"
+    "Sec-Fetch-Site: none\r\n"
+    "Sec-Fetch-User: ?1\r\n"
+    "\r\n",
+    // Safari
+    "GET /big.bin HTTP/1.1\r\n"
+    "Host: 192.168.1.10:9190\r\n"
+    "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,*/*;q=0.8\r\n"
+    "Upgrade-Insecure-Requests: 1\r\n"
+    "User-Agent: Mozilla/5.0 (Macintosh; Intel Mac OS X 10_15_7) AppleWebKit/605.1.15 (KHTML, like Gecko) Version/17.0 Safari/605.1.15\r\n"
+    "Accept-Language: zh-CN,zh-Hans;q=0.9\r\n"
+    "Accept-Encoding: gzip, deflate\r\n"
+    "Connection: keep-alive\r\n"
+    "\r\n",
+    // curl
+    "GET /index.html HTTP/1.1\r\n"
+    "Host: 127.0.0.1:9190\r\n"
+    "User-Agent: curl/7.81.0\r\n"
+    "Accept: */*\r\n"
+    "\r\n",
+};
+
+static double now_sec()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// 原先的实现：逐字节查找"\r\n"，头部名称用strncasecmp逐个比较
+static int parse_baseline(char* buf, int len)
+{
+    int found = 0;
+    int start = 0;
+    for (int i = 0; i < len; ++i)
+    {
+        if (buf[i] == '\r' && i + 1 < len && buf[i + 1] == '\n')
+        {
+            const char* text = buf + start;
+            if (strncasecmp(text, "Connection:", 11) == 0)
+            {
+                found += 1;
+            }
+            else if (strncasecmp(text, "Content-Length:", 15) == 0)
+            {
+                found += 2;
+            }
+            else if (strncasecmp(text, "Host:", 5) == 0)
+            {
+                found += 3;
+            }
+            start = ++i + 1;
+        }
+    }
+    return found;
+}
+
+// 新实现：向量化查找行结束符和冒号，完美哈希匹配头部名称
+static int parse_scan(find_either_func find, char* buf, int len)
+{
+    int found = 0;
+    const char* p = buf;
+    const char* end = buf + len;
+    while (p < end)
+    {
+        const char* eol = find(p, end, '\r', '\n');
+        if (eol == end)
+        {
+            break;
+        }
+        const char* colon = find(p, eol, ':', ':');
+        if (colon != eol)
+        {
+            found += lookup_header(p, colon - p);
+        }
+        p = eol + 2;
+    }
+    return found;
+}
+
+static void report(const char* impl, int bytes, int rounds, int requests, double elapsed)
+{
+    printf("{\"impl\":\"%s\",\"bytes\":%d,\"rounds\":%d,\"ns_per_request\":%.1f,\"mb_per_sec\":%.1f}\n",
+           impl, bytes, rounds, elapsed * 1e9 / ((double)rounds * requests),
+           (double)bytes * rounds / elapsed / (1 << 20));
+}
+
+int main(int argc, char* argv[])
+{
+    int rounds = (argc > 1) ? atoi(argv[1]) : 200000;
+    int count = sizeof(corpus) / sizeof(corpus[0]);
+    std::vector<std::string> requests(corpus, corpus + count);
+    int bytes = 0;
+    for (int i = 0; i < count; ++i)
+    {
+        bytes += requests[i].size();
+    }
+
+    struct { const char* name; find_either_func func; } impls[] =
+    {
+        {"scalar", find_either_scalar},
+        {"sse42", __builtin_cpu_supports("sse4.2") ? find_either_sse42 : NULL},
+        {"avx2", __builtin_cpu_supports("avx2") ? find_either_avx2 : NULL},
+    };
+
+    volatile int sink = 0;
+    double start = now_sec();
+    for (int r = 0; r < rounds; ++r)
+    {
+        for (int i = 0; i < count; ++i)
+        {
+            sink += parse_baseline(&requests[i][0], requests[i].size());
+        }
+    }
+    report("baseline", bytes, rounds, count, now_sec() - start);
+
+    for (size_t k = 0; k < sizeof(impls) / sizeof(impls[0]); ++k)
+    {
+        if (impls[k].func == NULL)
+        {
+            continue;
+        }
+        start = now_sec();
+        for (int r = 0; r < rounds; ++r)
+        {
+            for (int i = 0; i < count; ++i)
+            {
+                sink += parse_scan(impls[k].func, &requests[i][0], requests[i].size());
+            }
+        }
+        report(impls[k].name, bytes, rounds, count, now_sec() - start);
+    }
+    printf("{\"selected\":\"%s\"}\n", find_either_impl_name());
+    return 0;
+}
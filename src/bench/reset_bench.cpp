@@ -0,0 +1,179 @@
+/**
+ * 连接状态重置基准测试：每个连接先通过socket读入并解析一个真实的请求、构造响应，再测量重置的开销
+ *   write_done：长连接响应发送完毕后的write_done()，归还缓冲区和文件引用、重设超时，
+ *     并注销可写事件、重新注册读事件（各一次epoll_ctl）
+ *   init：关闭连接时释放资源之后的init()，重置解析和发送状态
+ * 用法：reset_bench [connection_count] [rounds]
+ *   connection_count：轮流重置的连接数，默认1024，模拟大量连接时的缓存压力，每个连接占用两个文件描述符
+ *   rounds：每个连接的重置次数，默认1000
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <sys/socket.h>
+
+#include "../http_conn.h"
+
+static const int HOT_CONNECTIONS = 16;    // 数据常驻缓存的连接数
+static const char REQUEST[] = "GET /index.html HTTP/1.1\r\nHost: localhost\r\nConnection: keep-alive\r\n\r\n";
+static const char BODY[] = "<html><body>reset_bench</body></html>\n";
+
+static inline uint64_t now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static bool timeout_cb(void* data)
+{
+    return false;
+}
+
+// 与main.cpp相同，时间轮节点移出时释放连接的引用
+static void timer_detach_cb(void* data)
+{
+    ((http_conn*)data)->release();
+}
+
+/**
+ * 通过友元调用http_conn的私有函数
+*/
+struct reset_bench
+{
+    // 从对端写入请求，按事件循环的路径读取、解析并构造响应，停在等待发送的状态
+    static bool prepare(http_conn* conn, int peer)
+    {
+        if (send(peer, REQUEST, sizeof(REQUEST) - 1, 0) != (ssize_t)(sizeof(REQUEST) - 1))
+        {
+            return false;
+        }
+        return conn->read() && conn->process_requests() == http_conn::PROCESS_DONE && conn->m_response_count == 1;
+    }
+    static void write_done(http_conn* conn)
+    {
+        conn->write_done();
+    }
+    // close_conn()在init()之前释放文件引用和缓冲区，不计入init()的时间
+    static void release(http_conn* conn)
+    {
+        conn->unmap();
+        conn->free_buffers();
+    }
+    static void init(http_conn* conn)
+    {
+        conn->init();
+    }
+};
+
+static void run_case(const char* name, http_conn** conns, int* peers, int count, int rounds, bool closing)
+{
+    uint64_t elapsed = 0;
+    for (int r = 0; r < rounds; ++r)
+    {
+        for (int i = 0; i < count; ++i)
+        {
+            if (!reset_bench::prepare(conns[i], peers[i]))
+            {
+                printf("prepare failed\n");
+                exit(1);
+            }
+            if (closing)
+            {
+                reset_bench::release(conns[i]);
+            }
+        }
+
+        uint64_t begin = now_ns();
+        for (int i = 0; i < count; ++i)
+        {
+            if (closing)
+            {
+                reset_bench::init(conns[i]);
+            }
+            else
+            {
+                reset_bench::write_done(conns[i]);
+            }
+        }
+        elapsed += now_ns() - begin;
+    }
+    printf("{\"case\":\"%s\",\"connections\":%d,\"resets\":%lld,\"ns_per_reset\":%.2f}\n",
+           name, count, (long long)count * rounds, (double)elapsed / ((double)count * rounds));
+}
+
+int main(int argc, char* argv[])
+{
+    int count = argc > 1 ? atoi(argv[1]) : 1024;
+    int rounds = argc > 2 ? atoi(argv[2]) : 1000;
+    if (count <= 0 || rounds <= 0)
+    {
+        printf("usage: %s [connection_count] [rounds]\n", argv[0]);
+        return 1;
+    }
+
+    // 在临时目录中准备目标文件
+    char root[] = "/tmp/reset_bench.XXXXXX";
+    if (!mkdtemp(root))
+    {
+        perror("mkdtemp");
+        return 1;
+    }
+    char path[64];
+    snprintf(path, sizeof(path), "%s/index.html", root);
+    FILE* fp = fopen(path, "w");
+    if (!fp)
+    {
+        perror("fopen");
+        return 1;
+    }
+    fputs(BODY, fp);
+    fclose(fp);
+    http_conn::m_doc_root = root;
+
+    struct event_base* base = event_base_new();
+    timer_wheel* wheel = new timer_wheel(base, timeout_cb, timer_detach_cb);
+    wheel->bind_thread();
+    file_cache::instance()->init(16, 1 << 20, true);
+    file_cache::instance()->attach(base);
+    http_response::instance()->attach(base);
+
+    // 与main.cpp相同，连接对象从连接表分配，关闭后归还槽位
+    conn_table::instance()->init(count);
+    http_conn** conns = new http_conn*[count];
+    int* peers = new int[count];
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    for (int i = 0; i < count; ++i)
+    {
+        int fds[2];
+        if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, fds) != 0)
+        {
+            perror("socketpair");
+            return 1;
+        }
+        conns[i] = conn_table::instance()->open();
+        conns[i]->init(fds[0], addr, base, nullptr, nullptr, wheel);
+        peers[i] = fds[1];
+    }
+
+    // 少量连接时数据常驻缓存，每批连接读一次时钟
+    int hot = count < HOT_CONNECTIONS ? count : HOT_CONNECTIONS;
+    run_case("write_done", conns, peers, hot, rounds * (count / hot), false);
+    run_case("write_done", conns, peers, count, rounds, false);
+    run_case("init", conns, peers, hot, rounds * (count / hot), true);
+    run_case("init", conns, peers, count, rounds, true);
+
+    for (int i = 0; i < count; ++i)
+    {
+        conns[i]->close_conn();
+        close(peers[i]);
+    }
+    delete [] conns;
+    delete [] peers;
+    unlink(path);
+    rmdir(root);
+    return 0;
+}
@@ -0,0 +1,193 @@
+/**
+ * 响应构造基准测试：比较原先每个头部字段经过vsnprintf格式化与预先生成的报文块的每个响应耗时
+ *   error_404：404错误响应（状态行、头部和正文）
+ *   file_200：文件响应的头部，包括Content-Length、ETag和Last-Modified
+ *   stats_200：统计报文的头部，Content-Length在每次响应时格式化
+ *   itoa：格式化一个整数，snprintf与查表法比较
+ *   date：生成Date行，每次响应gmtime_r加strftime与复制每秒刷新一次的缓存比较
+ * 前三种响应都带Date行，原先的做法每次格式化日期，预先生成的做法复制缓存的Date行
+ * 用法：response_bench [rounds]
+ *   rounds：每种响应构造的次数，默认10000000
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdarg.h>
+#include <string.h>
+#include <time.h>
+
+#include "../http_response.h"
+
+static char g_buf[4096];
+static int g_idx = 0;
+
+static inline uint64_t now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+/**** 原先http_conn::add_response()等函数的做法 ****/
+static bool add_response(const char* format, ...)
+{
+    va_list arg_list;
+    va_start(arg_list, format);
+    int len = vsnprintf(g_buf + g_idx, sizeof(g_buf) - 1 - g_idx, format, arg_list);
+    va_end(arg_list);
+    if (len >= (int)sizeof(g_buf) - 1 - g_idx)
+    {
+        return false;
+    }
+    g_idx += len;
+    return true;
+}
+
+static bool add_date()
+{
+    char date[32];
+    struct tm tm;
+    time_t now = time(nullptr);
+    gmtime_r(&now, &tm);
+    strftime(date, sizeof(date), "%a, %d %b %Y %H:%M:%S GMT", &tm);
+    return add_response("Date: %s\r\n", date);
+}
+
+static bool add_headers(int content_len, bool linger)
+{
+    return add_response("Content-Length: %d\r\n", content_len)
+           && add_date()
+           && add_response("Connection: %s\r\n", linger ? "keep-alive" : "close")
+           && add_response("%s", "\r\n");
+}
+
+/**** 预先生成的报文块，与http_conn::add_parts()相同 ****/
+template<typename... Parts>
+static bool add_parts(const Parts&... parts)
+{
+    if (g_idx + http_response::max_len(parts...) > (int)sizeof(g_buf))
+    {
+        return false;
+    }
+    g_idx += http_response::build(g_buf + g_idx, parts...);
+    return true;
+}
+
+static double run(int test, bool prerendered, long rounds)
+{
+    const char* form = "The requested file was not found on this server.\n";
+    struct stat st;
+    memset(&st, 0, sizeof(st));
+    st.st_ino = 1234567;
+    st.st_size = 16384;
+    st.st_mtim.tv_sec = 1700000000;
+    char file_header[http_response::FILE_HEADER_LEN];
+    http_response::validators validators;
+    int file_header_len = http_response::file_header(file_header, st, &validators);
+    http_response* response = http_response::instance();
+    uint64_t sink = 0;
+    uint64_t begin = now_ns();
+    for (long i = 0; i < rounds; ++i)
+    {
+        g_idx = 0;
+        bool linger = i & 1;
+        int length = 1000 + (int)(i & 0xfff);
+        switch (test)
+        {
+            case 0:
+                if (prerendered)
+                {
+                    add_parts(response->head(http_response::RESPONSE_404), http_response::date(),
+                              response->tail(http_response::RESPONSE_404, linger));
+                }
+                else
+                {
+                    add_response("%s %d %s\r\n", "HTTP/1.1", 404, "Not Found");
+                    add_headers(strlen(form), linger);
+                    add_response("%s", form);
+                }
+                break;
+            case 1:
+                if (prerendered)
+                {
+                    // 头部在打开文件时生成，每次响应只复制
+                    add_parts(http_response::block(file_header, file_header_len), http_response::date(),
+                              http_response::connection(linger));
+                }
+                else
+                {
+                    char date[32];
+                    struct tm tm;
+                    gmtime_r(&st.st_mtim.tv_sec, &tm);
+                    strftime(date, sizeof(date), "%a, %d %b %Y %H:%M:%S GMT", &tm);
+                    add_response("%s %d %s\r\n", "HTTP/1.1", 200, "OK");
+                    add_response("ETag: \"%lu-%llu-%lld\"\r\n", (unsigned long)st.st_ino,
+                                 (unsigned long long)st.st_mtim.tv_sec * 1000000000ull + st.st_mtim.tv_nsec, (long long)st.st_size);
+                    add_response("Last-Modified: %s\r\n", date);
+                    add_headers(16384, linger);
+                }
+                break;
+            case 2:
+                if (prerendered)
+                {
+                    add_parts(http_response::stats_header(), "Content-Length: ", (uint64_t)length, "\r\n",
+                              http_response::date(), http_response::connection(linger));
+                }
+                else
+                {
+                    add_response("%s %d %s\r\n", "HTTP/1.1", 200, "OK");
+                    add_response("Content-Type: text/plain; version=0.0.4\r\n");
+                    add_headers(length, linger);
+                }
+                break;
+            case 3:
+                if (prerendered)
+                {
+                    g_idx = http_response::format_uint(g_buf, (uint64_t)i * 7919);
+                }
+                else
+                {
+                    g_idx = snprintf(g_buf, sizeof(g_buf), "%llu", (unsigned long long)i * 7919);
+                }
+                break;
+            case 4:
+                if (prerendered)
+                {
+                    add_parts(http_response::date());
+                }
+                else
+                {
+                    add_date();
+                }
+                break;
+        }
+        sink += g_idx + g_buf[g_idx / 2];
+    }
+    double ns = (double)(now_ns() - begin) / rounds;
+    if (sink == 0)
+    {
+        printf("\n");
+    }
+    return ns;
+}
+
+int main(int argc, char* argv[])
+{
+    long rounds = argc > 1 ? atol(argv[1]) : 10000000;
+    if (rounds <= 0)
+    {
+        printf("usage: %s [rounds]\n", argv[0]);
+        return 1;
+    }
+
+    const char* names[] = { "error_404", "file_200", "stats_200", "itoa", "date" };
+    for (int test = 0; test < 5; ++test)
+    {
+        double old_ns = run(test, false, rounds);
+        double new_ns = run(test, true, rounds);
+        printf("{\"case\":\"%s\",\"vsnprintf_ns\":%.1f,\"prerendered_ns\":%.1f,\"speedup\":%.1f}\n",
+               names[test], old_ns, new_ns, old_ns / new_ns);
+        fflush(stdout);
+    }
+    return 0;
+}
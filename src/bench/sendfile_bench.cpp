@@ -0,0 +1,211 @@
+/**
+ * 文件发送基准测试：比较mmap+writev与sendfile在1KB到1GB文件上的吞吐量
+ * 通过回环TCP连接发送，接收线程读取并丢弃数据
+ *   mmap_writev：每次发送都重新mmap/munmap（缓存之前的服务器行为）
+ *   cached_mmap_writev：映射只建立一次（文件缓存命中时的行为）
+ *   sendfile：头部send(MSG_MORE)，正文sendfile
+ * 用法：sendfile_bench [max_size_bytes] [dir]
+ *   max_size_bytes：最大测试文件大小，默认1GB；文件大小从1KB开始每次乘以16
+ *   dir：临时文件所在目录，默认/tmp
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <sys/socket.h>
+#include <sys/sendfile.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+static inline uint64_t now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static const char header[] = "HTTP/1.1 200 OK\r\nContent-Length: 0000000000\r\nConnection: keep-alive\r\n\r\n";
+
+/**
+ * 接收线程，读取并丢弃所有数据直到连接关闭
+*/
+static void* drain(void* arg)
+{
+    int fd = (int)(intptr_t)arg;
+    static char buf[1 << 20];
+    while (read(fd, buf, sizeof(buf)) > 0)
+    {
+    }
+    close(fd);
+    return NULL;
+}
+
+static bool write_all_iov(int sock, struct iovec* iv, int count)
+{
+    while (count > 0)
+    {
+        ssize_t n = writev(sock, iv, count);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return false;
+        }
+        // 跳过已发送的部分
+        while (count > 0 && (size_t)n >= iv->iov_len)
+        {
+            n -= iv->iov_len;
+            ++iv;
+            --count;
+        }
+        if (count > 0)
+        {
+            iv->iov_base = (char*)iv->iov_base + n;
+            iv->iov_len -= n;
+        }
+    }
+    return true;
+}
+
+static bool send_writev(int sock, const char* address, size_t size)
+{
+    struct iovec iv[2];
+    iv[0].iov_base = (void*)header;
+    iv[0].iov_len = sizeof(header) - 1;
+    iv[1].iov_base = (void*)address;
+    iv[1].iov_len = size;
+    return write_all_iov(sock, iv, 2);
+}
+
+static bool send_mmap(int sock, int fd, size_t size)
+{
+    char* address = (char*)mmap(0, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (address == MAP_FAILED)
+    {
+        return false;
+    }
+    bool ret = send_writev(sock, address, size);
+    munmap(address, size);
+    return ret;
+}
+
+static bool send_sendfile(int sock, int fd, size_t size)
+{
+    if (send(sock, header, sizeof(header) - 1, MSG_MORE) != (ssize_t)sizeof(header) - 1)
+    {
+        return false;
+    }
+    off_t offset = 0;
+    while ((size_t)offset < size)
+    {
+        ssize_t n = sendfile(sock, fd, &offset, size - offset);
+        if (n <= 0 && errno != EINTR)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+static int connect_pair(int listenfd, const struct sockaddr_in& addr, pthread_t* tid)
+{
+    int sock = socket(AF_INET, SOCK_STREAM, 0);
+    if (connect(sock, (const struct sockaddr*)&addr, sizeof(addr)) < 0)
+    {
+        return -1;
+    }
+    int peer = accept(listenfd, NULL, NULL);
+    pthread_create(tid, NULL, drain, (void*)(intptr_t)peer);
+    return sock;
+}
+
+int main(int argc, char* argv[])
+{
+    long long max_size = argc > 1 ? atoll(argv[1]) : (1ll << 30);
+    const char* dir = argc > 2 ? argv[2] : "/tmp";
+
+    int listenfd = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t len = sizeof(addr);
+    if (bind(listenfd, (struct sockaddr*)&addr, sizeof(addr)) < 0 || listen(listenfd, 8) < 0
+        || getsockname(listenfd, (struct sockaddr*)&addr, &len) < 0)
+    {
+        printf("listen failed, errno is: %d\n", errno);
+        return 1;
+    }
+
+    static char chunk[1 << 20];
+    memset(chunk, 'x', sizeof(chunk));
+    for (long long size = 1024; size <= max_size; size *= 16)
+    {
+        char path[256];
+        snprintf(path, sizeof(path), "%s/sendfile_bench.%lld", dir, size);
+        int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0)
+        {
+            printf("open %s failed, errno is: %d\n", path, errno);
+            return 1;
+        }
+        for (long long written = 0; written < size; )
+        {
+            size_t n = (size - written) < (long long)sizeof(chunk) ? size - written : sizeof(chunk);
+            written += ::write(fd, chunk, n);
+        }
+        unlink(path);
+
+        // 每组至少发送256MB或3次
+        long long iterations = (256ll << 20) / size;
+        if (iterations < 3)
+        {
+            iterations = 3;
+        }
+        char* cached = (char*)mmap(0, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        const char* modes[] = { "mmap_writev", "cached_mmap_writev", "sendfile" };
+        for (int mode = 0; mode < 3; ++mode)
+        {
+            pthread_t tid;
+            int sock = connect_pair(listenfd, addr, &tid);
+            uint64_t begin = now_ns();
+            bool ok = true;
+            for (long long i = 0; i < iterations && ok; ++i)
+            {
+                if (mode == 0)
+                {
+                    ok = send_mmap(sock, fd, size);
+                }
+                else if (mode == 1)
+                {
+                    ok = send_writev(sock, cached, size);
+                }
+                else
+                {
+                    ok = send_sendfile(sock, fd, size);
+                }
+            }
+            uint64_t elapsed = now_ns() - begin;
+            close(sock);
+            pthread_join(tid, NULL);
+            printf("{\"mode\":\"%s\",\"file_size\":%lld,\"iterations\":%lld,\"ok\":%s,"
+                   "\"us_per_response\":%.1f,\"MBps\":%.1f}\n",
+                   modes[mode], size, iterations, ok ? "true" : "false",
+                   elapsed / 1e3 / iterations, (double)size * iterations / (1 << 20) / (elapsed / 1e9));
+            fflush(stdout);
+        }
+        munmap(cached, size);
+        close(fd);
+    }
+    close(listenfd);
+    return 0;
+}
@@ -0,0 +1,97 @@
+#!/bin/sh
+# 基准测试套件：生成临时资源目录，在本地回环地址启动http_server，用load_bench依次运行各场景，
+# 每个场景输出一行JSON。需要在src目录下先执行make和make bench，或者直接make bench-suite
+# 环境变量：
+#   PORT：http_server监听的端口，默认19190
+#   SERVER_OPTS：传给http_server的选项，例如"-r 4"或"-w -i"
+#   SECONDS_PER_RUN：每个场景的测量时间，默认5
+#   THREADS：load_bench的线程数，默认2
+#   OUT：结果另外写入该文件
+#   BASELINE：之前保存的结果文件，任何场景的req_per_sec比它低THRESHOLD%以上、
+#             或者出现错误时，以非0状态退出
+#   THRESHOLD：允许的吞吐量下降百分比，默认10
+
+cd "$(dirname "$0")/.." || exit 1
+PORT=${PORT:-19190}
+SECONDS_PER_RUN=${SECONDS_PER_RUN:-5}
+THREADS=${THREADS:-2}
+THRESHOLD=${THRESHOLD:-10}
+
+if [ ! -x ./http_server ] || [ ! -x ./bench/load_bench ]; then
+    echo "build http_server and bench/load_bench first: make && make bench" >&2
+    exit 1
+fi
+
+# 生成资源目录：不同大小的文件
+ROOT=$(mktemp -d /tmp/http_bench.XXXXXX)
+head -c 1024 /dev/zero | tr '\0' 'a' > "$ROOT/index.html"
+head -c 128 /dev/zero | tr '\0' 'b' > "$ROOT/small.txt"
+head -c 16384 /dev/urandom > "$ROOT/16k.bin"
+head -c 1048576 /dev/urandom > "$ROOT/1m.bin"
+for i in 1 2 3 4 5 6 7 8; do
+    head -c $((i * 2048)) /dev/urandom > "$ROOT/f$i.bin"
+done
+
+./http_server $SERVER_OPTS -d "$ROOT" 127.0.0.1 "$PORT" > /dev/null 2>&1 &
+SERVER=$!
+cleanup()
+{
+    kill "$SERVER" 2> /dev/null
+    wait "$SERVER" 2> /dev/null
+    rm -rf "$ROOT"
+}
+trap cleanup EXIT INT TERM
+sleep 1
+if ! kill -0 "$SERVER" 2> /dev/null; then
+    echo "http_server failed to start on port $PORT" >&2
+    exit 1
+fi
+
+RESULTS=$(mktemp /tmp/http_bench_result.XXXXXX)
+run()
+{
+    label=$1
+    shift
+    ./bench/load_bench -t "$THREADS" -s "$SECONDS_PER_RUN" -l "$label" "$@" 127.0.0.1 "$PORT" | tee -a "$RESULTS"
+}
+
+MIX="/index.html:60,/small.txt:10,/16k.bin:10,/f1.bin:2,/f2.bin:2,/f3.bin:2,/f4.bin:2,/f5.bin:2,/f6.bin:2,/f7.bin:2,/f8.bin:2,/1m.bin:1,/missing.html:3"
+run keepalive_1k        -c 64  -p 1 -m /index.html
+run pipeline8_1k        -c 64  -p 8 -m /index.html
+run pipeline16_default  -c 64  -p 16 -k 2 -m /index.html   # 不带Connection头部，同wrk、h2load
+run close_1k            -c 32  -k 0 -m /index.html
+run keepalive_1m        -c 16  -p 1 -m /1m.bin
+run mix                 -c 64  -p 2 -m "$MIX"
+run open_loop_20k       -c 64  -p 1 -r 20000 -m /index.html
+
+if [ -n "$OUT" ]; then
+    cp "$RESULTS" "$OUT"
+fi
+
+# 与基线比较
+status=0
+field()
+{
+    sed -n "s/.*\"$2\":\"\{0,1\}\([^,\"]*\).*/\1/p" <<EOF
+$1
+EOF
+}
+while read -r line; do
+    label=$(field "$line" label)
+    rps=$(field "$line" req_per_sec)
+    errors=$(field "$line" errors)
+    if [ "$errors" != "0" ]; then
+        echo "REGRESSION $label: $errors errors" >&2
+        status=1
+    fi
+    if [ -n "$BASELINE" ]; then
+        base=$(grep "\"label\":\"$label\"" "$BASELINE" | head -n 1)
+        base_rps=$(field "$base" req_per_sec)
+        if [ -n "$base_rps" ] && [ $((rps * 100)) -lt $((base_rps * (100 - THRESHOLD))) ]; then
+            echo "REGRESSION $label: $rps req/s, baseline $base_rps req/s" >&2
+            status=1
+        fi
+    fi
+done < "$RESULTS"
+rm -f "$RESULTS"
+exit $status
@@ -0,0 +1,112 @@
+/**
+ * 线程池基准测试：比较threadpool（共享队列）与ws_threadpool（工作窃取）
+ * 在1、4、16、64个工作线程下的吞吐量和任务延迟（入队到处理完成）
+ * 用法：threadpool_bench [task_count] [work_ns] [rate]
+ *   task_count：每组测试的任务数，默认200000
+ *   work_ns：每个任务的模拟处理时间（纳秒），默认1000
+ *   rate：开环模式每秒投递的任务数，默认0表示尽可能快地投递（闭环饱和）
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+#include <atomic>
+#include <vector>
+#include <algorithm>
+
+#include "../threadpool.h"
+#include "../ws_threadpool.h"
+
+static inline uint64_t now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static std::atomic<long> g_done(0);
+static uint64_t g_work_ns = 1000;
+
+/**
+ * 基准测试任务，记录入队时间和完成时间
+*/
+struct bench_task
+{
+    uint64_t enqueue_ns;
+    uint64_t finish_ns;
+
+    void process()
+    {
+        uint64_t start = now_ns();
+        while (now_ns() - start < g_work_ns)
+        {
+        }
+        finish_ns = now_ns();
+        g_done.fetch_add(1, std::memory_order_release);
+    }
+};
+
+template<typename POOL>
+static void run_case(const char* name, int threads, long count, long rate)
+{
+    POOL* pool = new POOL(threads, 65536);
+    std::vector<bench_task> tasks(count);
+    g_done.store(0);
+
+    uint64_t interval = rate > 0 ? 1000000000ull / rate : 0;
+    uint64_t begin = now_ns();
+    for (long i = 0; i < count; ++i)
+    {
+        if (interval)
+        {
+            uint64_t due = begin + i * interval;
+            while (now_ns() < due)
+            {
+            }
+        }
+        tasks[i].enqueue_ns = now_ns();
+        while (!pool->append(&tasks[i]))    // 队列已满时重试
+        {
+            sched_yield();
+        }
+    }
+    while (g_done.load(std::memory_order_acquire) < count)
+    {
+        sched_yield();
+    }
+    uint64_t elapsed = now_ns() - begin;
+
+    std::vector<uint64_t> lat(count);
+    for (long i = 0; i < count; ++i)
+    {
+        lat[i] = tasks[i].finish_ns - tasks[i].enqueue_ns;
+    }
+    std::sort(lat.begin(), lat.end());
+    printf("{\"pool\":\"%s\",\"threads\":%d,\"tasks\":%ld,\"rate\":%ld,\"throughput\":%.0f,"
+           "\"p50_us\":%.1f,\"p99_us\":%.1f,\"p999_us\":%.1f}\n",
+           name, threads, count, rate, count * 1e9 / elapsed,
+           lat[count / 2] / 1e3, lat[count * 99 / 100] / 1e3, lat[count * 999 / 1000] / 1e3);
+    fflush(stdout);
+    // 结束并回收工作线程，空闲线程不与之后的测试竞争CPU
+    delete pool;
+}
+
+int main(int argc, char* argv[])
+{
+    long count = argc > 1 ? atol(argv[1]) : 200000;
+    g_work_ns = argc > 2 ? atol(argv[2]) : 1000;
+    long rate = argc > 3 ? atol(argv[3]) : 0;
+    if (count <= 0)
+    {
+        printf("usage: %s [task_count] [work_ns] [rate]\n", argv[0]);
+        return 1;
+    }
+
+    const int thread_numbers[] = { 1, 4, 16, 64 };
+    for (int i = 0; i < 4; ++i)
+    {
+        run_case< threadpool<bench_task> >("threadpool", thread_numbers[i], count, rate);
+        run_case< ws_threadpool<bench_task> >("ws_threadpool", thread_numbers[i], count, rate);
+    }
+    return 0;
+}
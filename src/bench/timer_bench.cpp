@@ -0,0 +1,107 @@
+/**
+ * 连接超时定时器基准测试：大量连接时每次重设超时的开销
+ * 比较timer_wheel::schedule()、libevent的event_add（最小堆）和libevent的common timeout队列，
+ * 每次随机选择一个定时器推后到期时间，模拟连接上每个请求重设超时
+ * 用法：timer_bench [timer_count] [touches]
+ *   timer_count：定时器数量，默认100000
+ *   touches：重设超时的总次数，默认10000000
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+#include <vector>
+
+#include "../timer_wheel.h"
+
+static inline uint64_t now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static bool noop_timeout(void* data)
+{
+    return true;
+}
+
+static void noop_cb(int fd, short events, void* arg)
+{
+}
+
+static void report(const char* name, int count, long touches, uint64_t elapsed)
+{
+    printf("{\"timer\":\"%s\",\"timers\":%d,\"touches\":%ld,\"ns_per_touch\":%.2f}\n",
+           name, count, touches, (double)elapsed / touches);
+    fflush(stdout);
+}
+
+static void run_wheel(int count, long touches, const std::vector<int>& order)
+{
+    timer_wheel wheel(nullptr, noop_timeout);
+    std::vector<timer_node> nodes(count);
+    for (int i = 0; i < count; ++i)
+    {
+        wheel.schedule(&nodes[i], wheel.after(15));
+    }
+    uint64_t begin = now_ns();
+    for (long i = 0; i < touches; ++i)
+    {
+        // 每1/512的重设前进一个tick，使到期时间分布在不同的槽中
+        if ((i & 511) == 0)
+        {
+            wheel.advance();
+        }
+        wheel.schedule(&nodes[order[i % order.size()]], wheel.after(15));
+    }
+    report("timer_wheel", count, touches, now_ns() - begin);
+}
+
+static void run_libevent(int count, long touches, const std::vector<int>& order, bool common)
+{
+    struct event_base* base = event_base_new();
+    struct timeval tv = { 15, 0 };
+    const struct timeval* timeout = common ? event_base_init_common_timeout(base, &tv) : &tv;
+    std::vector<struct event*> events(count);
+    for (int i = 0; i < count; ++i)
+    {
+        events[i] = event_new(base, -1, 0, noop_cb, nullptr);
+        event_add(events[i], timeout);
+    }
+    uint64_t begin = now_ns();
+    for (long i = 0; i < touches; ++i)
+    {
+        event_add(events[order[i % order.size()]], timeout);
+    }
+    report(common ? "libevent_common" : "libevent_heap", count, touches, now_ns() - begin);
+    for (int i = 0; i < count; ++i)
+    {
+        event_free(events[i]);
+    }
+    event_base_free(base);
+}
+
+int main(int argc, char* argv[])
+{
+    int count = argc > 1 ? atoi(argv[1]) : 100000;
+    long touches = argc > 2 ? atol(argv[2]) : 10000000;
+    if (count <= 0 || touches <= 0)
+    {
+        printf("usage: %s [timer_count] [touches]\n", argv[0]);
+        return 1;
+    }
+
+    // 预先生成随机访问顺序，不计入测量时间
+    std::vector<int> order(1 << 20);
+    unsigned seed = 1;
+    for (size_t i = 0; i < order.size(); ++i)
+    {
+        order[i] = rand_r(&seed) % count;
+    }
+
+    run_wheel(count, touches, order);
+    run_libevent(count, touches, order, false);
+    run_libevent(count, touches, order, true);
+    return 0;
+}
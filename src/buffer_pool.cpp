@@ -0,0 +1,98 @@
+#include "buffer_pool.h"
+
+#include <stdlib.h>
+
+buffer_pool* buffer_pool::instance()
+{
+    static buffer_pool pool;
+    return &pool;
+}
+
+buffer_pool::buffer_pool()
+{
+    for (int i = 0; i < CLASS_COUNT; ++i)
+    {
+        m_lists[i].head = nullptr;
+        m_lists[i].cached_bytes = 0;
+    }
+}
+
+buffer_pool::~buffer_pool()
+{
+    for (int i = 0; i < CLASS_COUNT; ++i)
+    {
+        while (m_lists[i].head)
+        {
+            free_block* block = m_lists[i].head;
+            m_lists[i].head = block->next;
+            free(block);
+        }
+    }
+}
+
+int buffer_pool::size_class(int size)
+{
+    int cls = 0;
+    while (cls < CLASS_COUNT && (1 << (cls + MIN_SHIFT)) < size)
+    {
+        ++cls;
+    }
+    return cls < CLASS_COUNT ? cls : -1;
+}
+
+char* buffer_pool::allocate(int size, int* capacity)
+{
+    int cls = size_class(size);
+    if (cls < 0)    // 超过最大等级，不经过缓冲区池
+    {
+        *capacity = size;
+        return (char*)malloc(size);
+    }
+
+    int block_size = 1 << (cls + MIN_SHIFT);
+    *capacity = block_size;
+    free_list& list = m_lists[cls];
+    list.lock.lock();
+    free_block* block = list.head;
+    if (block)
+    {
+        list.head = block->next;
+        list.cached_bytes -= block_size;
+    }
+    list.lock.unlock();
+    if (!block)
+    {
+        return (char*)malloc(block_size);
+    }
+    return (char*)block;
+}
+
+void buffer_pool::deallocate(char* buf, int capacity)
+{
+    if (!buf)
+    {
+        return;
+    }
+    int cls = size_class(capacity);
+    if (cls < 0 || (1 << (cls + MIN_SHIFT)) != capacity)
+    {
+        free(buf);
+        return;
+    }
+
+    free_list& list = m_lists[cls];
+    list.lock.lock();
+    if (list.cached_bytes + capacity <= MAX_CACHED_BYTES)
+    {
+        free_block* block = (free_block*)buf;
+        block->next = list.head;
+        list.head = block;
+        list.cached_bytes += capacity;
+        buf = nullptr;
+    }
+    list.lock.unlock();
+    if (buf)    // 缓存已满，归还给系统
+    {
+        free(buf);
+    }
+}
@@ -0,0 +1,48 @@
+#ifndef BUFFER_POOL_H
+#define BUFFER_POOL_H
+
+#include <stddef.h>
+
+#include "locker.h"
+
+/**
+ * 连接缓冲区池
+ * 按2的幂划分大小等级（512B到1MB），释放的缓冲区挂在对应等级的空闲链表上供下次分配复用，
+ * 每个等级缓存的总字节数有上限，超出部分直接归还给系统
+*/
+class buffer_pool
+{
+public:
+    static buffer_pool* instance();
+    char* allocate(int size, int* capacity);    // 分配至少size字节的缓冲区，实际容量写入capacity
+    void deallocate(char* buf, int capacity);   // 归还缓冲区，capacity为allocate返回的容量
+
+private:
+    buffer_pool();
+    ~buffer_pool();
+    buffer_pool(const buffer_pool&);
+    buffer_pool& operator=(const buffer_pool&);
+
+    static const int MIN_SHIFT = 9;     // 最小等级512字节
+    static const int CLASS_COUNT = 12;  // 最大等级1MB
+    static const size_t MAX_CACHED_BYTES = 4 << 20;    // 每个等级最多缓存的字节数
+
+    // 空闲缓冲区链表节点，存放在空闲缓冲区自身的内存中
+    struct free_block
+    {
+        free_block* next;
+    };
+    struct free_list
+    {
+        locker lock;
+        free_block* head;
+        size_t cached_bytes;
+    };
+
+    static int size_class(int size);   // 返回容纳size字节的最小等级，超出最大等级返回-1
+
+private:
+    free_list m_lists[CLASS_COUNT];
+};
+
+#endif
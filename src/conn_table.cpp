@@ -0,0 +1,89 @@
+#include "conn_table.h"
+#include "http_conn.h"
+
+conn_table* conn_table::instance()
+{
+    static conn_table table;
+    return &table;
+}
+
+conn_table::conn_table() : m_chunks(nullptr), m_max_chunks(0), m_chunk_count(0)
+{
+}
+
+conn_table::~conn_table()
+{
+    for (int i = 0; i < m_chunk_count; ++i)
+    {
+        delete [] m_chunks[i].load(std::memory_order_relaxed);
+    }
+    delete [] m_chunks;
+}
+
+void conn_table::init(int max_connections)
+{
+    m_max_chunks = (max_connections + CHUNK_SIZE - 1) / CHUNK_SIZE;
+    m_chunks = new std::atomic<http_conn*>[m_max_chunks];
+    for (int i = 0; i < m_max_chunks; ++i)
+    {
+        m_chunks[i].store(nullptr, std::memory_order_relaxed);
+    }
+}
+
+bool conn_table::grow()
+{
+    if (m_chunk_count >= m_max_chunks)
+    {
+        return false;
+    }
+    http_conn* chunk = new http_conn[CHUNK_SIZE];
+    uint32_t base = (uint32_t)m_chunk_count << CHUNK_BITS;
+    for (int i = 0; i < CHUNK_SIZE; ++i)
+    {
+        chunk[i].m_handle.store((1ull << 32) | (base + i), std::memory_order_relaxed);
+    }
+    // 下标小的槽位先被使用
+    for (int i = CHUNK_SIZE - 1; i >= 0; --i)
+    {
+        m_free.push_back(base + i);
+    }
+    m_chunks[m_chunk_count++].store(chunk, std::memory_order_release);
+    return true;
+}
+
+http_conn* conn_table::open()
+{
+    m_lock.lock();
+    if (m_free.empty() && !grow())
+    {
+        m_lock.unlock();
+        return nullptr;
+    }
+    uint32_t index = m_free.back();
+    m_free.pop_back();
+    m_lock.unlock();
+    return m_chunks[index >> CHUNK_BITS].load(std::memory_order_relaxed) + (index & (CHUNK_SIZE - 1));
+}
+
+http_conn* conn_table::get(uint64_t handle)
+{
+    uint32_t index = index_of(handle);
+    if ((int)(index >> CHUNK_BITS) >= m_max_chunks)
+    {
+        return nullptr;
+    }
+    http_conn* chunk = m_chunks[index >> CHUNK_BITS].load(std::memory_order_acquire);
+    if (chunk == nullptr)
+    {
+        return nullptr;
+    }
+    http_conn* conn = chunk + (index & (CHUNK_SIZE - 1));
+    return (conn->m_handle.load(std::memory_order_acquire) == handle) ? conn : nullptr;
+}
+
+void conn_table::free(http_conn* conn)
+{
+    m_lock.lock();
+    m_free.push_back(index_of(conn->m_handle.load(std::memory_order_relaxed)));
+    m_lock.unlock();
+}
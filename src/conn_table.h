@@ -0,0 +1,48 @@
+#ifndef CONN_TABLE_H
+#define CONN_TABLE_H
+
+#include <stdint.h>
+#include <atomic>
+#include <vector>
+
+#include "locker.h"
+
+class http_conn;
+
+/**
+ * 连接表：按需分配http_conn，内存与实际并发连接数成正比，不再按fd预先分配
+ * 每个连接用句柄标识，句柄由槽位下标和代数组成，连接关闭时代数加一，之前的句柄随即失效。
+ * 连接对象在关闭且没有任务引用后才回到空闲链表，排队中的任务不会落到复用该槽位的新连接上
+*/
+class conn_table
+{
+public:
+    static conn_table* instance();
+    void init(int max_connections);     // 设置最大连接数，需要在open()之前调用
+    http_conn* open();  // 分配一个连接对象，连接数已达上限返回nullptr
+    http_conn* get(uint64_t handle);    // 根据句柄查找连接，连接已关闭返回nullptr
+    void free(http_conn* conn);     // 连接关闭且引用全部释放后归还槽位，由http_conn调用
+
+    static uint32_t index_of(uint64_t handle) { return (uint32_t)handle; }
+    static uint64_t next_generation(uint64_t handle) { return handle + (1ull << 32); }
+
+private:
+    conn_table();
+    ~conn_table();
+    conn_table(const conn_table&);
+    conn_table& operator=(const conn_table&);
+
+    static const int CHUNK_BITS = 10;   // 每次分配1024个连接对象
+    static const int CHUNK_SIZE = 1 << CHUNK_BITS;
+
+    bool grow();    // 分配一个新的块，调用者持有m_lock
+
+private:
+    std::atomic<http_conn*>* m_chunks;  // 块指针数组，按最大连接数一次分配，查找时无需加锁
+    int m_max_chunks;
+    int m_chunk_count;
+    locker m_lock;      // 保护空闲链表和块的分配
+    std::vector<uint32_t> m_free;   // 空闲槽位下标
+};
+
+#endif
@@ -0,0 +1,348 @@
+#include "file_cache.h"
+#include "server_metrics.h"
+#include "logger.h"
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/inotify.h>
+#include <vector>
+
+file_cache* file_cache::instance()
+{
+    static file_cache cache;
+    return &cache;
+}
+
+file_cache::file_cache() : m_max_entries(0), m_max_bytes(0), m_map_files(true), m_inotify_fd(-1), m_inotify_ev(nullptr)
+{
+    for (int i = 0; i < SHARD_COUNT; ++i)
+    {
+        m_shards[i].bytes = 0;
+    }
+}
+
+file_cache::~file_cache()
+{
+    if (m_inotify_ev != nullptr)
+    {
+        event_free(m_inotify_ev);
+    }
+    if (m_inotify_fd != -1)
+    {
+        close(m_inotify_fd);
+    }
+}
+
+/**
+ * 设置缓存容量，需要在attach()之前调用
+ * max_entries：最多缓存的文件数
+ * max_bytes：缓存文件的总字节数上限，超过单个分片容量的文件不缓存
+ * map_files：是否mmap文件内容
+*/
+void file_cache::init(size_t max_entries, size_t max_bytes, bool map_files)
+{
+    m_max_entries = max_entries / SHARD_COUNT;
+    m_max_bytes = max_bytes / SHARD_COUNT;
+    m_map_files = map_files;
+}
+
+void file_cache::attach(struct event_base* base)
+{
+    m_inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (m_inotify_fd < 0)   // 无法监视文件变更时不缓存
+    {
+        LOG_WARN("inotify_init1 failed, errno is: %d, file cache disabled", errno);
+        return;
+    }
+    m_inotify_ev = event_new(base, m_inotify_fd, EV_READ | EV_PERSIST, inotify_cb, this);
+    event_add(m_inotify_ev, NULL);
+}
+
+file_cache::shard& file_cache::get_shard(const std::string& path)
+{
+    return m_shards[std::hash<std::string>()(path) % SHARD_COUNT];
+}
+
+file_cache::FILE_STATUS file_cache::open_file(const char* path, file_entry** entry, bool body)
+{
+    struct stat st;
+    if (stat(path, &st) < 0)    // 文件不存在
+    {
+        return FILE_NOT_FOUND;
+    }
+    if (!(st.st_mode & S_IROTH))    // 没有可读权限
+    {
+        return FILE_FORBIDDEN;
+    }
+    if (S_ISDIR(st.st_mode))    // 请求的是文件夹
+    {
+        return FILE_IS_DIR;
+    }
+
+    int fd = body ? open(path, O_RDONLY | O_CLOEXEC) : -1;
+    if (body && fd < 0)
+    {
+        return (errno == EACCES) ? FILE_FORBIDDEN : FILE_ERROR;
+    }
+    char* address = nullptr;
+    if (body && m_map_files && st.st_size > 0)
+    {
+        address = (char*)mmap(0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (address == MAP_FAILED)
+        {
+            close(fd);
+            return FILE_ERROR;
+        }
+    }
+
+    file_entry* e = new file_entry;
+    e->path = path;
+    e->fd = fd;
+    e->st = st;
+    e->address = address;
+    e->header_len = http_response::file_header(e->header, st, &e->validators);
+    e->refcount.store(1);
+    e->wd = -1;
+    *entry = e;
+    return FILE_OK;
+}
+
+void file_cache::destroy(file_entry* entry)
+{
+    if (entry->address)
+    {
+        munmap(entry->address, entry->st.st_size);
+    }
+    if (entry->fd != -1)
+    {
+        close(entry->fd);
+    }
+    delete entry;
+}
+
+/**
+ * 获取文件，返回FILE_OK时*entry有效，使用完毕后必须调用release()
+ * 只取文件属性的缓存项不加入缓存，由调用者独占
+*/
+file_cache::FILE_STATUS file_cache::acquire(const char* path, file_entry** entry, bool body)
+{
+    std::string key(path);
+    shard& s = get_shard(key);
+
+    // 命中缓存，移动到LRU表头
+    s.lock.lock();
+    std::unordered_map<std::string, file_entry*>::iterator it = s.entries.find(key);
+    if (it != s.entries.end())
+    {
+        file_entry* e = it->second;
+        s.lru.splice(s.lru.begin(), s.lru, e->lru_it);
+        e->refcount.fetch_add(1, std::memory_order_relaxed);
+        s.lock.unlock();
+        server_metrics::add(server_metrics::CACHE_HITS);
+        *entry = e;
+        return FILE_OK;
+    }
+    s.lock.unlock();
+
+    // 未命中，在锁外打开文件
+    server_metrics::add(server_metrics::CACHE_MISSES);
+    file_entry* e = nullptr;
+    FILE_STATUS status = open_file(path, &e, body);
+    if (status != FILE_OK)
+    {
+        return status;
+    }
+    if (!body || m_inotify_fd == -1 || (size_t)e->st.st_size > m_max_bytes)    // 不缓存，由调用者独占
+    {
+        *entry = e;
+        return FILE_OK;
+    }
+
+    s.lock.lock();
+    it = s.entries.find(key);
+    if (it != s.entries.end())  // 其他线程已经加入缓存，使用已有的缓存项
+    {
+        file_entry* cached = it->second;
+        cached->refcount.fetch_add(1, std::memory_order_relaxed);
+        s.lock.unlock();
+        destroy(e);
+        *entry = cached;
+        return FILE_OK;
+    }
+    bool cached = insert(s, e);
+    if (cached)
+    {
+        e->refcount.fetch_add(1, std::memory_order_relaxed);    // 缓存持有的引用
+    }
+    s.lock.unlock();
+
+    // 监视在打开文件之后才加入，其间的修改或替换不会产生通知：加入监视后再stat一次，
+    // 文件已变化时移出缓存，本次请求仍使用已打开的文件
+    struct stat st;
+    if (cached && (stat(path, &st) < 0 || changed(st, e->st)))
+    {
+        s.lock.lock();
+        it = s.entries.find(key);
+        if (it != s.entries.end() && it->second == e)
+        {
+            remove(s, e);
+        }
+        s.lock.unlock();
+    }
+    *entry = e;
+    return FILE_OK;
+}
+
+bool file_cache::changed(const struct stat& now, const struct stat& opened)
+{
+    return now.st_ino != opened.st_ino || now.st_dev != opened.st_dev || now.st_size != opened.st_size
+           || now.st_mtim.tv_sec != opened.st_mtim.tv_sec || now.st_mtim.tv_nsec != opened.st_mtim.tv_nsec;
+}
+
+/**
+ * 只查找缓存，命中时与acquire()相同，未命中返回false，由调用者决定是否在其他线程中调用acquire()
+*/
+bool file_cache::acquire_cached(const char* path, file_entry** entry)
+{
+    std::string key(path);
+    shard& s = get_shard(key);
+    s.lock.lock();
+    std::unordered_map<std::string, file_entry*>::iterator it = s.entries.find(key);
+    if (it == s.entries.end())
+    {
+        s.lock.unlock();
+        return false;
+    }
+    file_entry* e = it->second;
+    s.lru.splice(s.lru.begin(), s.lru, e->lru_it);
+    e->refcount.fetch_add(1, std::memory_order_relaxed);
+    s.lock.unlock();
+    server_metrics::add(server_metrics::CACHE_HITS);   // 未命中由随后的acquire()计数
+    *entry = e;
+    return true;
+}
+
+void file_cache::release(file_entry* entry)
+{
+    if (entry->refcount.fetch_sub(1, std::memory_order_acq_rel) == 1)
+    {
+        destroy(entry);
+    }
+}
+
+/**
+ * 将缓存项加入分片并开始监视文件，超出容量时从LRU表尾淘汰
+*/
+bool file_cache::insert(shard& s, file_entry* entry)
+{
+    m_watch_lock.lock();
+    entry->wd = inotify_add_watch(m_inotify_fd, entry->path.c_str(),
+                                  IN_MODIFY | IN_ATTRIB | IN_DELETE_SELF | IN_MOVE_SELF);
+    if (entry->wd < 0)  // 监视数量达到上限等情况，不缓存
+    {
+        m_watch_lock.unlock();
+        entry->wd = -1;
+        return false;
+    }
+    m_watches.insert(std::make_pair(entry->wd, entry->path));
+    m_watch_lock.unlock();
+
+    s.entries[entry->path] = entry;
+    s.lru.push_front(entry);
+    entry->lru_it = s.lru.begin();
+    s.bytes += entry->st.st_size;
+
+    while (s.lru.size() > m_max_entries || s.bytes > m_max_bytes)
+    {
+        file_entry* victim = s.lru.back();
+        if (victim == entry)
+        {
+            break;
+        }
+        remove(s, victim);
+    }
+    return true;
+}
+
+/**
+ * 将缓存项移出分片，停止监视并释放缓存持有的引用
+*/
+void file_cache::remove(shard& s, file_entry* entry)
+{
+    s.entries.erase(entry->path);
+    s.lru.erase(entry->lru_it);
+    s.bytes -= entry->st.st_size;
+
+    m_watch_lock.lock();
+    typedef std::unordered_multimap<int, std::string>::iterator watch_iter;
+    std::pair<watch_iter, watch_iter> range = m_watches.equal_range(entry->wd);
+    for (watch_iter it = range.first; it != range.second; ++it)
+    {
+        if (it->second == entry->path)
+        {
+            m_watches.erase(it);
+            break;
+        }
+    }
+    if (m_watches.count(entry->wd) == 0)    // 没有其他缓存项使用该监视描述符
+    {
+        inotify_rm_watch(m_inotify_fd, entry->wd);
+    }
+    m_watch_lock.unlock();
+    entry->wd = -1;
+
+    release(entry);
+}
+
+void file_cache::invalidate(int wd)
+{
+    std::vector<std::string> paths;
+    m_watch_lock.lock();
+    typedef std::unordered_multimap<int, std::string>::iterator watch_iter;
+    std::pair<watch_iter, watch_iter> range = m_watches.equal_range(wd);
+    for (watch_iter it = range.first; it != range.second; ++it)
+    {
+        paths.push_back(it->second);
+    }
+    m_watch_lock.unlock();
+
+    for (size_t i = 0; i < paths.size(); ++i)
+    {
+        shard& s = get_shard(paths[i]);
+        s.lock.lock();
+        std::unordered_map<std::string, file_entry*>::iterator it = s.entries.find(paths[i]);
+        if (it != s.entries.end() && it->second->wd == wd)
+        {
+            remove(s, it->second);
+        }
+        s.lock.unlock();
+    }
+}
+
+/**
+ * inotify可读事件回调函数，文件变更时使对应缓存项失效，正在使用旧缓存项的请求不受影响
+*/
+void file_cache::inotify_cb(int fd, short events, void* arg)
+{
+    file_cache* cache = (file_cache*)arg;
+    char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    while (true)
+    {
+        ssize_t len = read(fd, buf, sizeof(buf));
+        if (len <= 0)
+        {
+            break;
+        }
+        for (char* ptr = buf; ptr < buf + len; )
+        {
+            struct inotify_event* ev = (struct inotify_event*)ptr;
+            if (!(ev->mask & IN_IGNORED))
+            {
+                cache->invalidate(ev->wd);
+            }
+            ptr += sizeof(struct inotify_event) + ev->len;
+        }
+    }
+}
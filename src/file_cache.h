@@ -0,0 +1,88 @@
+#ifndef FILE_CACHE_H
+#define FILE_CACHE_H
+
+#include <sys/stat.h>
+#include <stddef.h>
+#include <atomic>
+#include <list>
+#include <string>
+#include <unordered_map>
+#include <event.h>
+
+#include "locker.h"
+#include "http_response.h"
+
+/**
+ * 文件缓存项：保存打开的文件描述符、文件属性和内存映射，由引用计数管理生命周期
+*/
+struct file_entry
+{
+    std::string path;       // 文件完整路径，缓存的键
+    int fd;                 // 打开的文件描述符，只取文件属性时为-1
+    struct stat st;         // 文件属性
+    char* address;          // mmap映射的起始地址，空文件或不映射时为nullptr
+    char header[http_response::FILE_HEADER_LEN];    // 预先生成的200状态行、Content-Length、ETag和Last-Modified行
+    int header_len;
+    http_response::validators validators;   // 指向header中的ETag和Last-Modified
+    std::atomic<int> refcount;  // 引用计数，缓存本身持有一个引用
+    int wd;                 // inotify监视描述符，-1表示未加入缓存
+    std::list<file_entry*>::iterator lru_it;    // 在LRU链表中的位置
+};
+
+/**
+ * 共享的打开文件/mmap缓存
+ * 以文件路径为键，按LRU和总字节数淘汰；通过inotify监视文件，文件被修改、删除或移动时使缓存项失效。
+ * 命中缓存时请求路径上没有任何文件系统调用
+*/
+class file_cache
+{
+public:
+    enum FILE_STATUS { FILE_OK = 0, FILE_NOT_FOUND, FILE_FORBIDDEN, FILE_IS_DIR, FILE_ERROR };
+
+public:
+    static file_cache* instance();
+    void init(size_t max_entries, size_t max_bytes, bool map_files);    // 设置缓存容量和是否映射文件
+    void attach(struct event_base* base);   // 在事件循环上注册inotify事件，开始缓存文件
+    // 获取文件，成功时增加引用计数；body为false时只需要文件属性（HEAD请求），未命中缓存时不打开和映射文件
+    FILE_STATUS acquire(const char* path, file_entry** entry, bool body = true);
+    bool acquire_cached(const char* path, file_entry** entry);  // 只在缓存中查找，不进行文件系统调用
+    void release(file_entry* entry);    // 释放acquire获得的引用
+
+private:
+    file_cache();
+    ~file_cache();
+    file_cache(const file_cache&);
+    file_cache& operator=(const file_cache&);
+
+    static const int SHARD_COUNT = 16;  // 分片数，降低多线程访问时的锁竞争
+
+    // 缓存分片，每个分片有独立的锁、哈希表和LRU链表
+    struct shard
+    {
+        locker lock;
+        std::unordered_map<std::string, file_entry*> entries;
+        std::list<file_entry*> lru;     // 表头为最近使用
+        size_t bytes;   // 缓存文件的总字节数
+    };
+
+    static void inotify_cb(int fd, short events, void* arg);   // 处理文件变更通知
+    FILE_STATUS open_file(const char* path, file_entry** entry, bool body);    // 打开并映射文件，body为false时只取文件属性
+    static void destroy(file_entry* entry);     // 关闭文件并解除映射
+    static bool changed(const struct stat& now, const struct stat& opened);  // 文件在打开之后是否被修改或替换
+    shard& get_shard(const std::string& path);
+    bool insert(shard& s, file_entry* entry);   // 调用者持有分片锁
+    void remove(shard& s, file_entry* entry);   // 调用者持有分片锁
+    void invalidate(int wd);    // 使监视描述符对应的缓存项失效
+
+private:
+    shard m_shards[SHARD_COUNT];
+    locker m_watch_lock;    // 保护m_watches，加锁顺序在分片锁之后
+    std::unordered_multimap<int, std::string> m_watches;    // 监视描述符到路径，硬链接会共享同一监视描述符
+    size_t m_max_entries;   // 每个分片允许缓存的最大文件数
+    size_t m_max_bytes;     // 每个分片允许缓存的最大字节数
+    bool m_map_files;       // 是否mmap文件，sendfile模式下只需要文件描述符
+    int m_inotify_fd;       // 为-1时不缓存，每次请求都打开文件
+    struct event* m_inotify_ev;
+};
+
+#endif
@@ -0,0 +1,85 @@
+#include "hdr_histogram.h"
+
+hdr_histogram::hdr_histogram()
+{
+    reset();
+}
+
+void hdr_histogram::add(const hdr_histogram& other)
+{
+    for (int i = 0; i < COUNTS_LEN; ++i)
+    {
+        uint64_t n = other.m_counts[i].load(std::memory_order_relaxed);
+        if (n != 0)
+        {
+            add_to(m_counts[i], n);
+        }
+    }
+    add_to(m_sum, other.sum());
+}
+
+void hdr_histogram::reset()
+{
+    for (int i = 0; i < COUNTS_LEN; ++i)
+    {
+        m_counts[i].store(0, std::memory_order_relaxed);
+    }
+    m_sum.store(0, std::memory_order_relaxed);
+}
+
+uint64_t hdr_histogram::count() const
+{
+    uint64_t total = 0;
+    for (int i = 0; i < COUNTS_LEN; ++i)
+    {
+        total += m_counts[i].load(std::memory_order_relaxed);
+    }
+    return total;
+}
+
+uint64_t hdr_histogram::max() const
+{
+    for (int i = COUNTS_LEN - 1; i >= 0; --i)
+    {
+        if (m_counts[i].load(std::memory_order_relaxed) != 0)
+        {
+            return highest_equivalent(i);
+        }
+    }
+    return 0;
+}
+
+uint64_t hdr_histogram::highest_equivalent(int index)
+{
+    int bucket = (index >> (SUB_BUCKET_BITS - 1)) - 1;
+    uint64_t sub = index & (SUB_BUCKET_HALF - 1);
+    if (bucket < 0)     // 第0个桶的128个子桶宽度都是1
+    {
+        return index;
+    }
+    return ((sub + SUB_BUCKET_HALF + 1) << bucket) - 1;
+}
+
+uint64_t hdr_histogram::percentile(double p) const
+{
+    uint64_t total = count();
+    if (total == 0)
+    {
+        return 0;
+    }
+    uint64_t target = (uint64_t)(p / 100 * total + 0.5);
+    if (target < 1)
+    {
+        target = 1;
+    }
+    uint64_t seen = 0;
+    for (int i = 0; i < COUNTS_LEN; ++i)
+    {
+        seen += m_counts[i].load(std::memory_order_relaxed);
+        if (seen >= target)
+        {
+            return highest_equivalent(i);
+        }
+    }
+    return 0;
+}
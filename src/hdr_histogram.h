@@ -0,0 +1,67 @@
+#ifndef HDR_HISTOGRAM_H
+#define HDR_HISTOGRAM_H
+
+#include <stdint.h>
+#include <atomic>
+
+/**
+ * 高动态范围直方图（HdrHistogram的对数-线性分桶）：值域0到2^40-1，每个2的幂区间分成64个子桶，
+ * 相对误差不超过1/64。计数只由一个线程写入，用relaxed的读加写代替原子加，记录时没有锁和原子读改写；
+ * 其他线程可以随时读取计数进行合并，读到的是某个时刻的近似值。记录时只更新子桶计数和总和，
+ * 总数和最大值在读取时由子桶计数得出
+*/
+class hdr_histogram
+{
+public:
+    static const int VALUE_BITS = 40;       // 可记录的最大值为2^40-1，超过的按最大值记录
+    static const int SUB_BUCKET_BITS = 7;   // 第0个桶有128个子桶，之后每个桶有64个子桶
+    static const int SUB_BUCKET_HALF = 1 << (SUB_BUCKET_BITS - 1);
+    static const int BUCKET_COUNT = VALUE_BITS - SUB_BUCKET_BITS + 1;
+    static const int COUNTS_LEN = (BUCKET_COUNT + 1) * SUB_BUCKET_HALF;
+    static const uint64_t MAX_VALUE = (1ull << VALUE_BITS) - 1;
+
+public:
+    hdr_histogram();
+    void record(uint64_t value, uint64_t count = 1);    // 记录count次value，只能由所属线程调用
+    void add(const hdr_histogram& other);   // 把other的计数加到本直方图
+    void reset();
+    uint64_t count() const;
+    uint64_t sum() const { return m_sum.load(std::memory_order_relaxed); }
+    uint64_t max() const;   // 最大值所在子桶的上界
+    uint64_t percentile(double p) const;    // 百分位数（0到100），返回所在子桶的上界
+
+    static int index_of(uint64_t value);
+    static uint64_t highest_equivalent(int index);  // 子桶中最大的值
+
+private:
+    hdr_histogram(const hdr_histogram&);
+    hdr_histogram& operator=(const hdr_histogram&);
+
+    static void add_to(std::atomic<uint64_t>& counter, uint64_t n)
+    {
+        counter.store(counter.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+
+private:
+    std::atomic<uint64_t> m_counts[COUNTS_LEN];
+    std::atomic<uint64_t> m_sum;
+};
+
+inline int hdr_histogram::index_of(uint64_t value)
+{
+    if (value > MAX_VALUE)
+    {
+        value = MAX_VALUE;
+    }
+    // 最高位决定桶，桶内按最高的SUB_BUCKET_BITS位线性划分
+    int bucket = 63 - __builtin_clzll(value | ((1ull << SUB_BUCKET_BITS) - 1)) - (SUB_BUCKET_BITS - 1);
+    return (bucket << (SUB_BUCKET_BITS - 1)) + (int)(value >> bucket);
+}
+
+inline void hdr_histogram::record(uint64_t value, uint64_t count)
+{
+    add_to(m_counts[index_of(value)], count);
+    add_to(m_sum, value * count);
+}
+
+#endif
@@ -1,94 +1,117 @@
 #include "http_conn.h"
 
-/**** HTTP响应内容 ****/
-const char* ok_200_title = "OK";
-const char* error_400_title = "Bad Request";
-const char* error_400_form = "Your request has bad syntax or is inherently impossible to satisfy.\n";
-const char* error_403_title = "Forbidden";
-const char* error_403_form = "You do not have permission to get file from this server.\n";
-const char* error_404_title = "Not Found";
-const char* error_404_form = "The requested file was not found on this server.\n";
-const char* error_500_title = "Internal Error";
-const char* error_500_form = "There was an unusual problem serving the requested file.\n";
-// 资源根目录
-const char* doc_root = "/home/bochen";
-
-/**
- * 设置为非阻塞
-*/
-int setnonblocking(int fd)
-{
-    int old_option = fcntl(fd, F_GETFL);
-    int new_option = old_option | O_NONBLOCK;
-    fcntl(fd, F_SETFL, new_option);
-    return old_option;
-}
-
 /**** 初始化静态变量 ****/
-int http_conn::m_user_count = 0;
+bool http_conn::m_use_sendfile = false;
+int http_conn::m_read_buffer_limit = 64 * 1024;
 struct event_base* http_conn::base = nullptr;
+int http_conn::m_header_timeout = 10;
+int http_conn::m_body_timeout = 30;
+int http_conn::m_keepalive_timeout = 15;
+int http_conn::m_write_timeout = 30;
+bool http_conn::m_inline = false;
+const char* http_conn::m_doc_root = "/home/bochen";
 
 void http_conn::close_conn()
 {
+    // 在所属事件循环线程中立即移出时间轮；工作线程中交给时间轮在两个tick内移出，节点可能处于不超时的槽中，
+    // 不能等它转一圈。节点移出后才释放它持有的引用，槽位不会在仍链接在原时间轮中时被其他事件循环的连接复用
+    if (m_wheel && m_wheel->in_loop())
+    {
+        arm_timer(timer_wheel::TIMER_OFF);
+    }
+    else if (m_wheel && m_sockfd != -1)
+    {
+        add_ref();  // 由时间轮处理cancel()后释放
+        m_wheel->cancel(&m_timer);
+    }
+    else
+    {
+        m_timer.expire.store(timer_wheel::TIMER_OFF, std::memory_order_relaxed);
+    }
+    unmap();
+    free_buffers();
     if(m_sockfd != -1)
     {
-        m_sockfd = -1;
-        m_user_count--;
-        // 释放资源，关闭连接
-        if (read_ev != nullptr)
-        {
-            event_free(read_ev);
-            read_ev = nullptr;
-        }
-        if (write_ev != nullptr)
-        {
-            event_free(write_ev);
-            write_ev = nullptr;
-        }
+        server_metrics::add(server_metrics::CONN_CLOSED);
+        // 注销事件处理器，关闭连接，事件结构留给复用该对象的下一个连接
+        event_del(&read_ev);
+        event_del(&write_ev);
         close(m_sockfd);
+        m_sockfd = -1;
+        // 使所有指向该连接的句柄失效，槽位在最后一个引用释放后才会被新连接复用
+        m_handle.store(conn_table::next_generation(m_handle.load(std::memory_order_relaxed)),
+                       std::memory_order_release);
+        init();
+        release();
+        return;
     }
     init();
 }
 
+void http_conn::release()
+{
+    if (m_refs.fetch_sub(1, std::memory_order_acq_rel) == 1)
+    {
+        conn_table::instance()->free(this);
+    }
+}
+
 /**
  * 初始化http_conn
  * sockfd：处理的客户端socket
  * addr：客户端地址
- * rev：读事件处理器
- * wev：可写事件处理器
+ * base：连接所属的事件循环
+ * read_cb：可读事件回调函数，参数为连接句柄
+ * write_cb：可写事件回调函数，参数为连接句柄
+ * wheel：所属事件循环的时间轮，用于读写超时
 */
-void http_conn::init(int sockfd, const sockaddr_in& addr, struct event* rev, struct event* wev)
+void http_conn::init(int sockfd, const sockaddr_in& addr, struct event_base* base,
+                     event_callback_fn read_cb, event_callback_fn write_cb, timer_wheel* wheel)
 {
     m_sockfd = sockfd;
     m_address = addr;
-    // 记录事件处理器
-    if (read_ev != nullptr)
-    {
-        event_free(read_ev);
-        read_ev = nullptr;
-    }
-    read_ev = rev;
-    if (write_ev != nullptr)
-    {
-        event_free(write_ev);
-        write_ev = nullptr;
-    }
-    write_ev = wev;
+    m_refs.store(1, std::memory_order_relaxed);     // 连接打开期间持有的引用
+    // 设置内嵌的读写事件处理器，回调参数为连接句柄
+    void* handle = (void*)(uintptr_t)m_handle.load(std::memory_order_relaxed);
+    event_assign(&read_ev, base, sockfd, EV_READ | EV_ET | EV_PERSIST, read_cb, handle);
+    event_assign(&write_ev, base, sockfd, EV_WRITE | EV_ET | EV_PERSIST, write_cb, handle);
 
-    int error = 0;
-    socklen_t len = sizeof(error);
-    getsockopt(m_sockfd, SOL_SOCKET, SO_ERROR, &error, &len);
-
-    // 注册读事件处理器
-    event_add(read_ev, NULL);
-    // 设置为非阻塞
-    setnonblocking(m_sockfd);
-    m_user_count++;
+    // 注册读事件处理器，socket由accept4()创建时已经是非阻塞的
+    event_add(&read_ev, NULL);
 
     init();
+    // 从建立连接开始计算头部超时
+    m_wheel = wheel;
+    m_deadline = deadline(m_header_timeout);
+    arm_timer(m_deadline);
 }
 
 void http_conn::init()
+{
+    m_start_line = 0;
+    m_request_start = 0;
+    m_checked_idx = 0;
+    m_read_idx = 0;
+    m_write_idx = 0;
+    m_file_count = 0;
+    m_segment_count = 0;
+    m_segment_idx = 0;
+    m_response_count = 0;
+    m_close_after_write = false;
+    m_idle = false;
+    m_cache_only = false;
+    m_lookup_pending = false;
+    m_read_stamp = 0;
+    m_queued_at = 0;
+    m_request_begin = 0;
+    m_parse_begin = 0;
+    m_lookup_begin = 0;
+    m_state.store(CONN_IDLE, std::memory_order_relaxed);
+    // 解析过程只依赖上面的下标，无需清空缓冲区
+    init_request();
+}
+
+void http_conn::init_request()
 {
     // 初始状态为解析请求行
     m_check_state = CHECK_STATE_REQUESTLINE;
@@ -97,15 +120,112 @@ void http_conn::init()
     m_method = GET;
     m_url = 0;
     m_version = 0;
-    m_content_length = 0;
+    m_content_length = -1;
     m_host = 0;
-    m_start_line = 0;
-    m_checked_idx = 0;
-    m_read_idx = 0;
-    m_write_idx = 0;
-    memset(m_read_buf, '\0', READ_BUFFER_SIZE);
-    memset(m_write_buf, '\0', WRITE_BUFFER_SIZE);
-    memset(m_real_file, '\0', FILENAME_LEN);
+    m_if_none_match = 0;
+    m_if_modified_since = 0;
+    m_range = 0;
+    m_if_range = 0;
+}
+
+void http_conn::free_buffers()
+{
+    buffer_pool::instance()->deallocate(m_read_buf, m_read_buf_size);
+    m_read_buf = nullptr;
+    m_read_buf_size = 0;
+    buffer_pool::instance()->deallocate(m_write_buf, m_write_buf_size);
+    m_write_buf = nullptr;
+    m_write_buf_size = 0;
+}
+
+unsigned http_conn::deadline(int seconds)
+{
+    return m_wheel ? m_wheel->after(seconds) : timer_wheel::TIMER_NEVER;
+}
+
+void http_conn::arm_timer(unsigned expire)
+{
+    // 节点在时间轮中期间持有一个引用，由时间轮的detach回调释放
+    if (m_wheel && m_wheel->schedule(&m_timer, expire))
+    {
+        add_ref();
+    }
+}
+
+/**
+ * 连接交给process()处理期间不计时，process()结束时通过m_timer.expire恢复，
+ * 时间轮在下一个tick把节点移到新的到期时间对应的槽
+*/
+void http_conn::pause_timer()
+{
+    arm_timer(timer_wheel::TIMER_BUSY);
+}
+
+/**
+ * 将读缓冲区扩大一倍，已解析出的请求行指针随缓冲区一起移动
+*/
+bool http_conn::grow_read_buf()
+{
+    if (m_read_buf_size >= m_read_buffer_limit)     // 请求头部过长
+    {
+        return false;
+    }
+    int size = m_read_buf ? m_read_buf_size * 2 : READ_BUFFER_SIZE;
+    if (size > m_read_buffer_limit)
+    {
+        size = m_read_buffer_limit;
+    }
+
+    int capacity = 0;
+    char* buf = buffer_pool::instance()->allocate(size, &capacity);
+    if (!buf)
+    {
+        return false;
+    }
+    if (m_read_buf)
+    {
+        memcpy(buf, m_read_buf, m_read_idx);
+        relocate_request(buf, 0);
+        buffer_pool::instance()->deallocate(m_read_buf, m_read_buf_size);
+    }
+    m_read_buf = buf;
+    m_read_buf_size = capacity;
+    return true;
+}
+
+/**
+ * 读缓冲区内容从m_read_buf移动到buf并整体前移shift字节后，修正指向缓冲区的请求行指针
+*/
+void http_conn::relocate_request(char* buf, int shift)
+{
+    if (m_url)
+    {
+        m_url = buf + (m_url - m_read_buf) - shift;
+    }
+    if (m_version)
+    {
+        m_version = buf + (m_version - m_read_buf) - shift;
+    }
+    if (m_host)
+    {
+        m_host = buf + (m_host - m_read_buf) - shift;
+    }
+    if (m_if_none_match)
+    {
+        m_if_none_match = buf + (m_if_none_match - m_read_buf) - shift;
+    }
+    if (m_if_modified_since)
+    {
+        m_if_modified_since = buf + (m_if_modified_since - m_read_buf) - shift;
+    }
+    if (m_range)
+    {
+        m_range = buf + (m_range - m_read_buf) - shift;
+    }
+    if (m_if_range)
+    {
+        m_if_range = buf + (m_if_range - m_read_buf) - shift;
+    }
 }
 
 /**
@@ -113,54 +233,47 @@ void http_conn::init()
 */
 http_conn::LINE_STATUS http_conn::parse_line()
 {
-    char temp;
-    for ( ; m_checked_idx < m_read_idx; ++m_checked_idx)
+    // 向量化查找行结束符
+    const char* end = m_read_buf + m_read_idx;
+    const char* pos = find_either(m_read_buf + m_checked_idx, end, '\r', '\n');
+    m_checked_idx = pos - m_read_buf;
+    if (pos == end)     // 行数据尚不完整
     {
-        // '\r'和'\n'紧接
-        temp = m_read_buf[m_checked_idx];
-        if (temp == '\r')
-        {
-            if ((m_checked_idx + 1) == m_read_idx)
-            {
-                return LINE_OPEN;
-            }
-            else if (m_read_buf[m_checked_idx + 1] == '\n') // 行数据完整
-            {
-                // 换行符置'\0'，后续可根据'\0'快速找到行尾
-                m_read_buf[m_checked_idx++] = '\0';
-                m_read_buf[m_checked_idx++] = '\0';
-                return LINE_OK;
-            }
+        return LINE_OPEN;
+    }
 
-            return LINE_BAD;
+    // '\r'和'\n'紧接
+    if (*pos == '\r')
+    {
+        if ((m_checked_idx + 1) == m_read_idx)
+        {
+            return LINE_OPEN;
         }
-        else if (temp == '\n')
+        else if (m_read_buf[m_checked_idx + 1] == '\n') // 行数据完整
         {
-            if ((m_checked_idx > 1) && (m_read_buf[m_checked_idx - 1] == '\r'))
-            {
-                m_read_buf[m_checked_idx-1] = '\0';
-                m_read_buf[m_checked_idx++] = '\0';
-                return LINE_OK;
-            }
-            return LINE_BAD;
+            // 换行符置'\0'，后续可根据'\0'快速找到行尾
+            m_read_buf[m_checked_idx++] = '\0';
+            m_read_buf[m_checked_idx++] = '\0';
+            return LINE_OK;
         }
     }
 
-    // 行数据尚不完整
-    return LINE_OPEN;
+    // 单独出现的'\r'或'\n'
+    return LINE_BAD;
 }
 
 bool http_conn::read()
 {
-    if (m_read_idx >= READ_BUFFER_SIZE)
-    {
-        return false;
-    }
-
     int bytes_read = 0;
+    bool fresh = (m_read_idx == m_request_start);   // 读缓冲区中没有未处理的请求数据
     while (true)    // 非阻塞读
     {
-        bytes_read = recv(m_sockfd, m_read_buf + m_read_idx, READ_BUFFER_SIZE - m_read_idx, 0);
+        // 缓冲区已满时扩大，保留一个字节给parse_content()写入的字符串结束符
+        if (m_read_idx + 1 >= m_read_buf_size && !grow_read_buf())
+        {
+            return false;
+        }
+        bytes_read = recv(m_sockfd, m_read_buf + m_read_idx, m_read_buf_size - 1 - m_read_idx, 0);
         if (bytes_read == -1)
         {
             if (errno == EAGAIN || errno == EWOULDBLOCK)     // TCP读缓冲区为空，等待下一次可读事件
@@ -176,6 +289,18 @@ bool http_conn::read()
         }
 
         m_read_idx += bytes_read;
+        server_metrics::add(server_metrics::BYTES_IN, bytes_read);
+    }
+    m_read_stamp = latency_stats::now();
+    m_parse_begin = m_read_stamp;
+    if (fresh && m_read_idx > m_request_start)  // 新的请求开始，从此刻计算到最后一个字节的时间
+    {
+        m_request_begin = m_read_stamp;
+    }
+    if (m_idle && m_read_idx > 0)   // 长连接上下一个请求开始，改为计算头部超时
+    {
+        m_idle = false;
+        m_deadline = deadline(m_header_timeout);
     }
     return true;
 }
@@ -194,11 +319,15 @@ http_conn::HTTP_CODE http_conn::parse_request_line(char* text)
     *m_url++ = '\0';
 
     char* method = text;
-    // 本服务器目前只支持"GET"方法
+    // 本服务器目前只支持"GET"和"HEAD"方法
     if (strcasecmp(method, "GET") == 0)
     {
         m_method = GET;
     }
+    else if (strcasecmp(method, "HEAD") == 0)
+    {
+        m_method = HEAD;
+    }
     else
     {
         return BAD_REQUEST;
@@ -231,6 +360,8 @@ http_conn::HTTP_CODE http_conn::parse_request_line(char* text)
         return BAD_REQUEST;
     }
 
+    // HTTP/1.1默认保持连接，只有Connection: close时关闭
+    m_linger = true;
     // 下一状态为解析头部
     m_check_state = CHECK_STATE_HEADER;
     return NO_REQUEST;
@@ -243,39 +374,91 @@ http_conn::HTTP_CODE http_conn::parse_headers(char* text)
 {
     if (text[0] == '\0')    // 空行
     {
-        if (m_content_length != 0)    // 有正文
+        if (m_content_length > 0)     // 有正文
         {
             // 下一状态为解析正文
             m_check_state = CHECK_STATE_CONTENT;
+            m_deadline = deadline(m_body_timeout);
             return NO_REQUEST;
         }
         // 没有正文，解析完成
         return GET_REQUEST;
     }
-    else if (strncasecmp(text, "Connection:", 11) == 0) // 解析Connection选项
-    {
-        text += 11;
-        text += strspn(text, " \t");
-        if (strcasecmp(text, "keep-alive") == 0)
-        {
-            m_linger = true;
-        }
-    }
-    else if (strncasecmp(text, "Content-Length:", 15) == 0) // 解析Content-Length选项
-    {
-        text += 15;
-        text += strspn(text, " \t");
-        m_content_length = atol(text);
-    }
-    else if (strncasecmp(text, "Host:", 5) == 0)    // 解析Host选项
+
+    // 行尾的"\r\n"已被parse_line()置为"\0\0"，m_checked_idx指向下一行
+    const char* end = m_read_buf + m_checked_idx - 2;
+    char* colon = (char*)find_either(text, end, ':', ':');
+    HEADER_ID header = (colon == end) ? HEADER_UNKNOWN : lookup_header(text, colon - text);
+    char* value = colon + 1;
+    if (header != HEADER_UNKNOWN)
     {
-        text += 5;
-        text += strspn(text, " \t");
-        m_host = text;
+        value += strspn(value, " \t");
     }
-    else    // 其他头部选项不解析
+    switch (header)
     {
-        printf("unknow header %s\n", text);
+        case HEADER_CONNECTION:     // 解析Connection选项，值为逗号分隔的选项列表
+        {
+            for (char* option = value; *option; option += strspn(option, ", \t"))
+            {
+                size_t len = strcspn(option, ", \t");
+                if (len == 5 && strncasecmp(option, "close", 5) == 0)
+                {
+                    m_linger = false;
+                }
+                option += len;
+            }
+            break;
+        }
+        case HEADER_CONTENT_LENGTH:     // 解析Content-Length选项
+        {
+            // 正文连同头部必须放入读缓冲区；非数字、负数、溢出、超过读缓冲区上限或重复且值不同时拒绝请求，
+            // 否则跳过正文时读缓冲区的下标会越界
+            if (!isdigit((unsigned char)value[0]))
+            {
+                return BAD_REQUEST;
+            }
+            char* end = nullptr;
+            errno = 0;
+            long length = strtol(value, &end, 10);
+            end += strspn(end, " \t");
+            if (*end != '\0' || errno == ERANGE || length > m_read_buffer_limit
+                || (m_content_length >= 0 && m_content_length != length))
+            {
+                return BAD_REQUEST;
+            }
+            m_content_length = (int)length;
+            break;
+        }
+        case HEADER_HOST:   // 解析Host选项
+        {
+            m_host = value;
+            break;
+        }
+        case HEADER_IF_NONE_MATCH:      // 条件请求，在process_write()中与文件的验证器比较
+        {
+            m_if_none_match = value;
+            break;
+        }
+        case HEADER_IF_MODIFIED_SINCE:
+        {
+            m_if_modified_since = value;
+            break;
+        }
+        case HEADER_RANGE:      // 字节范围请求，在process_write()中按文件大小解析
+        {
+            m_range = value;
+            break;
+        }
+        case HEADER_IF_RANGE:
+        {
+            m_if_range = value;
+            break;
+        }
+        default:    // 其他头部选项不解析
+        {
+            LOG_DEBUG("unknown header %s", text);
+            break;
+        }
     }
 
     return NO_REQUEST;
@@ -284,9 +467,9 @@ http_conn::HTTP_CODE http_conn::parse_headers(char* text)
 http_conn::HTTP_CODE http_conn::parse_content(char* text)
 {
     // 没有真正解析HTTP请求的消息体，只是判断它是否被完整地读入
-    if (m_read_idx >= (m_content_length + m_checked_idx))
+    // 正文之后可能紧跟流水线中的下一个请求，不能在正文末尾写入结束符
+    if (m_read_idx - m_checked_idx >= m_content_length)
     {
-        text[m_content_length] = '\0';
         return GET_REQUEST;
     }
 
@@ -308,7 +491,7 @@ http_conn::HTTP_CODE http_conn::process_read()
         // 获取要解析的行
         text = get_line();
         m_start_line = m_checked_idx;
-        printf("got 1 http line: %s\n", text);
+        LOG_DEBUG("got 1 http line: %s", text);
 
         // 根据解析状态分别处理
         switch (m_check_state)
@@ -360,143 +543,482 @@ http_conn::HTTP_CODE http_conn::process_read()
 */
 http_conn::HTTP_CODE http_conn::do_request()
 {
-    // 构造完整路径
-    strcpy(m_real_file, doc_root);
-    int len = strlen(doc_root);
-    strncpy(m_real_file + len, m_url, FILENAME_LEN - len - 1);
-    // 获得文件属性
-    if (stat(m_real_file, &m_file_stat) < 0)    // 文件不存在
+    // 构造完整路径，过长的URL被截断
+    char real_file[FILENAME_LEN];
+    int len = strlen(m_doc_root);
+    int url_len = strnlen(m_url, FILENAME_LEN - len - 1);
+    memcpy(real_file, m_doc_root, len);
+    memcpy(real_file + len, m_url, url_len);
+    real_file[len + url_len] = '\0';
+    if (strcmp(m_url, latency_stats::STATS_URL) == 0 || strcmp(m_url, server_metrics::METRICS_URL) == 0)
     {
-        return NO_RESOURCE;
+        return STATS_REQUEST;
     }
-
-    if (!(m_file_stat.st_mode & S_IROTH))   // 没有可读权限
+    m_lookup_begin = latency_stats::now();
+    if (m_cache_only)   // 事件循环线程中不能进行文件系统调用
     {
-        return FORBIDDEN_REQUEST;
+        if (!file_cache::instance()->acquire_cached(real_file, &m_file))   // 未命中时由工作线程再次查找并计时
+        {
+            return CACHE_MISS;
+        }
+        latency_stats::record(latency_stats::LOOKUP, latency_stats::now() - m_lookup_begin);
+        return FILE_REQUEST;
     }
-
-    if (S_ISDIR(m_file_stat.st_mode))   // 请求的是文件夹
+    // 从文件缓存获得文件属性和内存映射，热点文件不产生文件系统调用；HEAD请求未命中时只取文件属性
+    file_cache::FILE_STATUS status = file_cache::instance()->acquire(real_file, &m_file, m_method != HEAD);
+    latency_stats::record(latency_stats::LOOKUP, latency_stats::now() - m_lookup_begin);
+    switch (status)
     {
-        return BAD_REQUEST;
+        case file_cache::FILE_OK:
+            return FILE_REQUEST;
+        case file_cache::FILE_NOT_FOUND:    // 文件不存在
+            return NO_RESOURCE;
+        case file_cache::FILE_FORBIDDEN:    // 没有可读权限
+            return FORBIDDEN_REQUEST;
+        case file_cache::FILE_IS_DIR:       // 请求的是文件夹
+            return BAD_REQUEST;
+        default:
+            return INTERNAL_ERROR;
     }
-
-    // 目标文件存在且合法，使用mmap将其映射到内存地址m_file_address处
-    int fd = open(m_real_file, O_RDONLY);
-    m_file_address = (char*)mmap(0, m_file_stat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
-    close(fd);
-    return FILE_REQUEST;
 }
 
 void http_conn::unmap()
 {
-    if (m_file_address)
+    if (m_file)
     {
-        munmap(m_file_address, m_file_stat.st_size);
-        m_file_address = nullptr;
+        file_cache::instance()->release(m_file);
+        m_file = nullptr;
     }
+    for (int i = 0; i < m_file_count; ++i)
+    {
+        file_cache::instance()->release(m_files[i]);
+    }
+    m_file_count = 0;
 }
 
+/**
+ * 非阻塞写，依次发送排队的数据段：连续的内存段合并成一次sendmsg，文件段在零拷贝模式下通过sendfile发送，
+ * 其前面的内存段带MSG_MORE与正文合并成完整的TCP报文段。
+ * 每次写后跳过已发送的部分，可写事件再次到来时从断点继续
+*/
 bool http_conn::write()
 {
-    int temp = 0;
-    int bytes_have_send = 0;
-    int bytes_to_send = m_write_idx;
-    if (bytes_to_send == 0)
+    bool progress = false;
+    while (m_segment_idx < m_segment_count)
     {
-        // 清除状态
-        init();
-        // 注销可写事件，重新注册读事件
-        event_del(write_ev);
-        event_add(read_ev, NULL);
-        return true;
-    }
+        segment* seg = m_segments + m_segment_idx;
+        ssize_t temp = 0;
+        if (seg->type == SEG_FILE)
+        {
+            temp = sendfile(m_sockfd, seg->fd, &seg->offset, seg->len);
+            if (temp == 0)  // 文件在发送过程中被截断
+            {
+                return false;
+            }
+        }
+        else
+        {
+            struct iovec iv[MAX_SEGMENTS];
+            int count = 0;
+            int i = m_segment_idx;
+            for ( ; i < m_segment_count && m_segments[i].type != SEG_FILE; ++i, ++count)
+            {
+                iv[count].iov_base = (void*)(m_segments[i].type == SEG_BUF
+                                             ? m_write_buf + m_segments[i].offset : m_segments[i].addr);
+                iv[count].iov_len = m_segments[i].len;
+            }
+            struct msghdr msg;
+            memset(&msg, 0, sizeof(msg));
+            msg.msg_iov = iv;
+            msg.msg_iovlen = count;
+            temp = sendmsg(m_sockfd, &msg, (i < m_segment_count) ? MSG_MORE : 0);
+        }
 
-    // 非阻塞写，使用writev，仍未处理只写一半的情况
-    while (true)
-    {
-        temp = writev(m_sockfd, m_iv, m_iv_count);
-        if (temp <= -1)
+        if (temp < 0)
         {
             if (errno == EAGAIN)     // TCP写缓存区已满，等待下一次可写事件
             {
+                if (progress)
+                {
+                    arm_timer(deadline(m_write_timeout));
+                }
                 return true;
             }
             // 其他错误，写失败
-            unmap();
             return false;
         }
 
-        // bytes_to_send -= temp;
-        bytes_have_send += temp;
-        if (bytes_to_send <= bytes_have_send)     // 发送HTTP相应成功
+        // 跳过已发送的部分
+        progress = true;
+        server_metrics::add(server_metrics::BYTES_OUT, temp);
+        if (seg->type == SEG_FILE)  // sendfile已推进文件偏移
         {
-            unmap();
-            if (m_linger)   // 长连接
+            seg->len -= temp;
+            if (seg->len == 0)
             {
-                // 清除状态
-                init();
-                // 注销可写事件，重新注册读事件
-                event_del(write_ev);
-                event_add(read_ev, NULL);
-                return true;
+                ++m_segment_idx;
             }
-            else
+            continue;
+        }
+        while (temp > 0)
+        {
+            seg = m_segments + m_segment_idx;
+            off_t n = (temp < seg->len) ? temp : seg->len;
+            seg->offset += n;
+            seg->addr += n;
+            seg->len -= n;
+            temp -= n;
+            if (seg->len == 0)
             {
-                return false;
+                ++m_segment_idx;
             }
         }
     }
+
+    // 发送HTTP响应成功
+    return write_done();
+}
+
+/**
+ * 所有排队的响应发送完毕。长连接时保留读缓冲区中流水线的后续请求，移到缓冲区开头并立即处理
+*/
+bool http_conn::write_done()
+{
+    latency_stats::record(latency_stats::LAST_BYTE, latency_stats::now() - m_request_begin, m_response_count);
+    unmap();
+    if (m_close_after_write)
+    {
+        // 正常关闭连接，避免RST丢弃尚未发出的响应数据
+        struct linger tmp = { 0, 0 };
+        setsockopt(m_sockfd, SOL_SOCKET, SO_LINGER, &tmp, sizeof(tmp));
+        return false;
+    }
+
+    int leftover = m_read_idx - m_request_start;
+    if (leftover > 0)
+    {
+        memmove(m_read_buf, m_read_buf + m_request_start, leftover);
+        relocate_request(m_read_buf, m_request_start);
+        m_checked_idx -= m_request_start;
+        m_start_line -= m_request_start;
+        m_read_idx = leftover;
+        m_request_start = 0;
+        m_deadline = deadline(m_header_timeout);
+    }
+    else
+    {
+        // 连接进入空闲，归还读缓冲区
+        buffer_pool::instance()->deallocate(m_read_buf, m_read_buf_size);
+        m_read_buf = nullptr;
+        m_read_buf_size = 0;
+        m_read_idx = 0;
+        m_checked_idx = 0;
+        m_start_line = 0;
+        m_request_start = 0;
+        m_idle = true;
+        m_deadline = deadline(m_keepalive_timeout);
+    }
+    arm_timer(m_deadline);
+    buffer_pool::instance()->deallocate(m_write_buf, m_write_buf_size);
+    m_write_buf = nullptr;
+    m_write_buf_size = 0;
+    m_write_idx = 0;
+    m_segment_count = 0;
+    m_segment_idx = 0;
+    m_response_count = 0;
+
+    // 注销可写事件，重新注册读事件
+    int state = m_state.exchange(CONN_IDLE, std::memory_order_acq_rel);
+    event_del(&write_ev);
+    event_add(&read_ev, NULL);
+    // 已读入的后续请求和发送期间被合并的可读事件不会再触发，主动激活
+    if (leftover > 0 || (state & STATE_PENDING))
+    {
+        event_active(&read_ev, EV_READ, 1);
+    }
+    return true;
 }
 
-bool http_conn::add_response(const char* format, ...)
+bool http_conn::grow_write_buf()
 {
-    if (m_write_idx >= WRITE_BUFFER_SIZE)
+    if (m_write_buf_size >= WRITE_BUFFER_LIMIT)
     {
         return false;
     }
-    va_list arg_list;
-    va_start(arg_list, format);
-    // 将可变参数格式化输出到一个字符数组
-    int len = vsnprintf(m_write_buf + m_write_idx, WRITE_BUFFER_SIZE - 1 - m_write_idx, format, arg_list);
-    if (len >= (WRITE_BUFFER_SIZE - 1 - m_write_idx))
+    int capacity = 0;
+    char* buf = buffer_pool::instance()->allocate(m_write_buf ? m_write_buf_size * 2 : WRITE_BUFFER_SIZE, &capacity);
+    if (!buf)
     {
         return false;
     }
-    m_write_idx += len;
-    va_end(arg_list);
+    if (m_write_buf)
+    {
+        memcpy(buf, m_write_buf, m_write_idx);
+        buffer_pool::instance()->deallocate(m_write_buf, m_write_buf_size);
+    }
+    m_write_buf = buf;
+    m_write_buf_size = capacity;
     return true;
 }
 
-bool http_conn::add_status_line(int status, const char* title)
+/**
+ * 添加待发送的数据段，与前一个写缓冲区数据段相邻时直接合并
+*/
+void http_conn::add_segment(int type, const char* addr, int fd, off_t offset, off_t len)
 {
-    return add_response("%s %d %s\r\n", "HTTP/1.1", status, title);
+    if (len == 0)
+    {
+        return;
+    }
+    if (type == SEG_BUF && m_segment_count > 0)
+    {
+        segment& last = m_segments[m_segment_count - 1];
+        if (last.type == SEG_BUF && last.offset + last.len == offset)
+        {
+            last.len += len;
+            return;
+        }
+    }
+    segment& seg = m_segments[m_segment_count++];
+    seg.type = type;
+    seg.addr = addr;
+    seg.fd = fd;
+    seg.offset = offset;
+    seg.len = len;
 }
 
-bool http_conn::add_headers(int content_len)
+/**
+ * HEAD请求的响应只有头部
+*/
+bool http_conn::add_static(http_response::STATIC_RESPONSE response)
 {
-    add_content_length(content_len);
-    add_linger();
-    add_blank_line();
+    http_response* r = http_response::instance();
+    if (m_method == HEAD)
+    {
+        return add_parts(r->head(response), http_response::date(), http_response::connection(m_linger));
+    }
+    return add_parts(r->head(response), http_response::date(), r->tail(response, m_linger));
 }
 
-bool http_conn::add_content_length(int content_len)
+/**
+ * If-None-Match存在时只比较ETag（弱比较），否则比较If-Modified-Since：
+ * 与Last-Modified完全相同时不必解析日期，否则解析后比较；晚于服务器当前时间的日期无效，忽略该头部
+*/
+bool http_conn::not_modified(const file_entry* file) const
 {
-    return add_response("Content-Length: %d\r\n", content_len);
+    if (m_if_none_match)
+    {
+        const http_response::block& etag = file->validators.etag;
+        const char* p = m_if_none_match;
+        while (*p != '\0')
+        {
+            p += strspn(p, " \t,");
+            if (*p == '*')
+            {
+                return true;
+            }
+            if (strncmp(p, "W/", 2) == 0)
+            {
+                p += 2;
+            }
+            const char* end = p + strcspn(p, " \t,");
+            if (end - p == etag.len && memcmp(p, etag.data, etag.len) == 0)
+            {
+                return true;
+            }
+            p = end;
+        }
+        return false;
+    }
+    if (m_if_modified_since)
+    {
+        time_t now = time(nullptr);
+        const http_response::block& last_modified = file->validators.last_modified;
+        if (strncmp(m_if_modified_since, last_modified.data, last_modified.len) == 0
+            && m_if_modified_since[last_modified.len] == '\0')
+        {
+            return file->st.st_mtim.tv_sec <= now;
+        }
+        struct tm tm;
+        memset(&tm, 0, sizeof(tm));
+        const char* end = strptime(m_if_modified_since, "%a, %d %b %Y %H:%M:%S GMT", &tm);
+        if (end == nullptr || end[strspn(end, " \t")] != '\0')
+        {
+            return false;
+        }
+        time_t since = timegm(&tm);
+        return since <= now && file->st.st_mtim.tv_sec <= since;
+    }
+    return false;
 }
 
-bool http_conn::add_linger()
+/**
+ * 解析"bytes="后逗号分隔的范围：first-last、first-或-suffix，last超出文件时截断到文件末尾
+ * 返回可满足的范围数，0表示都不可满足（416）；格式错误或范围过多时返回-1，忽略Range发送整个文件
+*/
+int http_conn::parse_range(off_t size, byte_range* ranges) const
 {
-    return add_response("Connection: %s\r\n", (m_linger == true) ? "keep-alive" : "close");
+    const char* p = m_range;
+    if (strncasecmp(p, "bytes=", 6) != 0)
+    {
+        return -1;
+    }
+    p += 6;
+    int count = 0;
+    while (true)
+    {
+        p += strspn(p, " \t");
+        char* end = nullptr;
+        off_t first = 0;
+        off_t last = size - 1;
+        bool satisfiable = false;
+        if (*p == '-')  // 最后suffix个字节
+        {
+            if (!isdigit((unsigned char)p[1]))
+            {
+                return -1;
+            }
+            off_t suffix = strtoll(p + 1, &end, 10);
+            first = (suffix < size) ? size - suffix : 0;
+            satisfiable = suffix > 0;
+        }
+        else
+        {
+            if (!isdigit((unsigned char)*p))
+            {
+                return -1;
+            }
+            first = strtoll(p, &end, 10);
+            if (*end != '-')
+            {
+                return -1;
+            }
+            ++end;
+            if (isdigit((unsigned char)*end))
+            {
+                last = strtoll(end, &end, 10);
+                if (last < first)
+                {
+                    return -1;
+                }
+                if (last >= size)
+                {
+                    last = size - 1;
+                }
+            }
+            satisfiable = first < size;
+        }
+        if (satisfiable)
+        {
+            if (count == MAX_RANGES)
+            {
+                return -1;
+            }
+            ranges[count].first = first;
+            ranges[count].len = last - first + 1;
+            ++count;
+        }
+        p = end + strspn(end, " \t");
+        if (*p == '\0')
+        {
+            return count;
+        }
+        if (*p != ',')
+        {
+            return -1;
+        }
+        ++p;
+    }
 }
 
-bool http_conn::add_blank_line()
+/**
+ * If-Range为ETag时强比较，为日期时须与Last-Modified完全相同
+*/
+bool http_conn::if_range_matches(const file_entry* file) const
 {
-    return add_response("%s", "\r\n");
+    if (!m_if_range)
+    {
+        return true;
+    }
+    const http_response::block& v = (m_if_range[0] == '"') ? file->validators.etag : file->validators.last_modified;
+    return strncmp(m_if_range, v.data, v.len) == 0 && m_if_range[v.len] == '\0';
 }
 
-bool http_conn::add_content(const char* content)
+void http_conn::add_body(off_t offset, off_t len)
 {
-    return add_response("%s", content);
+    if (m_use_sendfile)
+    {
+        add_segment(SEG_FILE, nullptr, m_file->fd, offset, len);
+    }
+    else
+    {
+        add_segment(SEG_MEM, m_file->address + offset, -1, 0, len);
+    }
+}
+
+/**
+ * 单个范围直接发送文件片段。多个范围以multipart/byteranges发送：各部分的头部和结束分隔符先写入写缓冲区，
+ * 得到正文总长度后再写响应头部，数据段按发送顺序引用写缓冲区中的这些位置和文件片段
+*/
+bool http_conn::add_ranges(const byte_range* ranges, int count)
+{
+    int start = m_write_idx;
+    uint64_t size = m_file->st.st_size;
+    const http_response::validators& v = m_file->validators;
+    if (count == 1)
+    {
+        const byte_range& r = ranges[0];
+        if (!add_parts(http_response::partial_content(), "Content-Length: ", (uint64_t)r.len,
+                       "\r\nContent-Range: bytes ", (uint64_t)r.first, "-", (uint64_t)(r.first + r.len - 1), "/", size, "\r\n",
+                       v.lines, http_response::date(), http_response::connection(m_linger)))
+        {
+            return false;
+        }
+        add_segment(SEG_BUF, nullptr, -1, start, m_write_idx - start);
+        add_body(r.first, r.len);
+    }
+    else
+    {
+        const http_response::block& boundary = http_response::instance()->boundary();
+        int part_end[MAX_RANGES + 1];   // 各部分头部的结束位置，最后一个为结束分隔符的结束位置
+        uint64_t body_len = 0;
+        for (int i = 0; i < count; ++i)
+        {
+            if (!add_parts("\r\n--", boundary, "\r\nContent-Range: bytes ", (uint64_t)ranges[i].first, "-",
+                           (uint64_t)(ranges[i].first + ranges[i].len - 1), "/", size, "\r\n\r\n"))
+            {
+                return false;
+            }
+            part_end[i] = m_write_idx;
+            body_len += ranges[i].len;
+        }
+        if (!add_parts("\r\n--", boundary, "--\r\n"))
+        {
+            return false;
+        }
+        part_end[count] = m_write_idx;
+        body_len += m_write_idx - start;
+
+        int header = m_write_idx;
+        if (!add_parts(http_response::partial_content(), "Content-Type: multipart/byteranges; boundary=", boundary,
+                       "\r\nContent-Length: ", body_len, "\r\n", v.lines, http_response::date(), http_response::connection(m_linger)))
+        {
+            return false;
+        }
+        add_segment(SEG_BUF, nullptr, -1, header, m_write_idx - header);
+        int part = start;
+        for (int i = 0; i < count; ++i)
+        {
+            add_segment(SEG_BUF, nullptr, -1, part, part_end[i] - part);
+            add_body(ranges[i].first, ranges[i].len);
+            part = part_end[i];
+        }
+        add_segment(SEG_BUF, nullptr, -1, part, part_end[count] - part);
+    }
+    // 文件在响应发送完毕后释放
+    m_files[m_file_count++] = m_file;
+    m_file = nullptr;
+    return true;
 }
 
 /**
@@ -504,13 +1026,14 @@ bool http_conn::add_content(const char* content)
 */
 bool http_conn::process_write(HTTP_CODE ret)
 {
+    // 流水线中的响应依次写入写缓冲区
+    int start = m_write_idx;
     switch (ret)
     {
         case INTERNAL_ERROR:    // 内部错误
         {
-            add_status_line(500, error_500_title);
-            add_headers(strlen(error_500_form));
-            if (!add_content(error_500_form))
+            server_metrics::add(server_metrics::STATUS_500);
+            if (!add_static(http_response::RESPONSE_500))
             {
                 return false;
             }
@@ -518,9 +1041,8 @@ bool http_conn::process_write(HTTP_CODE ret)
         }
         case BAD_REQUEST:   // 请求格式有错
         {
-            add_status_line(400, error_400_title);
-            add_headers(strlen(error_400_form));
-            if (!add_content(error_400_form))
+            server_metrics::add(server_metrics::STATUS_400);
+            if (!add_static(http_response::RESPONSE_400))
             {
                 return false;
             }
@@ -528,9 +1050,8 @@ bool http_conn::process_write(HTTP_CODE ret)
         }
         case NO_RESOURCE:   // 请求资源不存在
         {
-            add_status_line(404, error_404_title);
-            add_headers(strlen(error_404_form));
-            if (!add_content(error_404_form))
+            server_metrics::add(server_metrics::STATUS_404);
+            if (!add_static(http_response::RESPONSE_404))
             {
                 return false;
             }
@@ -538,36 +1059,83 @@ bool http_conn::process_write(HTTP_CODE ret)
         }
         case FORBIDDEN_REQUEST:     // 请求资源禁止访问
         {
-            add_status_line(403, error_403_title);
-            add_headers(strlen(error_403_form));
-            if (!add_content(error_403_form))
+            server_metrics::add(server_metrics::STATUS_403);
+            if (!add_static(http_response::RESPONSE_403))
             {
                 return false;
             }
             break;
         }
-        case FILE_REQUEST:  // 请求资源合法
+        case STATS_REQUEST:     // 请求延迟统计或服务器计数器
         {
-            add_status_line(200, ok_200_title);
-            if (m_file_stat.st_size != 0)
+            server_metrics::add(server_metrics::STATUS_200);
+            char body[8192];
+            int len = (strcmp(m_url, server_metrics::METRICS_URL) == 0) ?
+                      server_metrics::instance()->render(body, sizeof(body)) :
+                      latency_stats::instance()->render(body, sizeof(body));
+            if (!add_parts(http_response::stats_header(), "Content-Length: ", (uint64_t)len, "\r\n", http_response::date(),
+                           http_response::connection(m_linger), http_response::block(body, m_method == HEAD ? 0 : len)))
             {
-                add_headers(m_file_stat.st_size);
-                m_iv[0].iov_base = m_write_buf;
-                m_iv[0].iov_len = m_write_idx;
-                m_iv[1].iov_base = m_file_address;
-                m_iv[1].iov_len = m_file_stat.st_size;
-                m_iv_count = 2;
-                return true;
+                return false;
             }
-            else
+            break;
+        }
+        case FILE_REQUEST:  // 请求资源合法
+        {
+            if (not_modified(m_file))   // 客户端缓存的文件仍然有效
             {
-                const char* ok_string = "<html><body></body></html>";
-                add_headers(strlen(ok_string));
-                if (!add_content(ok_string))
+                server_metrics::add(server_metrics::STATUS_304);
+                if (!add_parts(http_response::not_modified(), m_file->validators.lines, http_response::date(),
+                               http_response::connection(m_linger)))
                 {
                     return false;
                 }
+                file_cache::instance()->release(m_file);
+                m_file = nullptr;
+                break;
+            }
+            // Range只用于GET，If-Range不一致或Range无法解析时发送整个文件
+            if (m_range && m_method == GET && m_file->st.st_size != 0 && if_range_matches(m_file))
+            {
+                byte_range ranges[MAX_RANGES];
+                int count = parse_range(m_file->st.st_size, ranges);
+                if (count > 0)
+                {
+                    server_metrics::add(server_metrics::STATUS_206);
+                    return add_ranges(ranges, count);
+                }
+                if (count == 0)     // 没有可满足的范围
+                {
+                    server_metrics::add(server_metrics::STATUS_416);
+                    if (!add_parts(http_response::range_not_satisfiable(), "Content-Range: bytes */", (uint64_t)m_file->st.st_size,
+                                   "\r\nContent-Length: 0\r\n", http_response::date(), http_response::connection(m_linger)))
+                    {
+                        return false;
+                    }
+                    file_cache::instance()->release(m_file);
+                    m_file = nullptr;
+                    break;
+                }
+            }
+            server_metrics::add(server_metrics::STATUS_200);
+            // 状态行、Content-Length和验证器在打开文件时已生成
+            if (!add_parts(http_response::block(m_file->header, m_file->header_len), http_response::date(),
+                           http_response::connection(m_linger)))
+            {
+                return false;
             }
+            if (m_method == HEAD || m_file->st.st_size == 0)    // 只有头部，不需要文件内容
+            {
+                file_cache::instance()->release(m_file);
+                m_file = nullptr;
+                break;
+            }
+            add_segment(SEG_BUF, nullptr, -1, start, m_write_idx - start);
+            add_body(0, m_file->st.st_size);
+            // 文件在响应发送完毕后释放
+            m_files[m_file_count++] = m_file;
+            m_file = nullptr;
+            return true;
         }
         default:
         {
@@ -575,33 +1143,192 @@ bool http_conn::process_write(HTTP_CODE ret)
         }
     }
 
-    m_iv[0].iov_base = m_write_buf;
-    m_iv[0].iov_len = m_write_idx;
-    m_iv_count = 1;
+    add_segment(SEG_BUF, nullptr, -1, start, m_write_idx - start);
     return true;
 }
 
 /**
- * 有线程池中的工作线程调用，这是处理HTTP请求的入口函数
+ * 由线程池中的工作线程调用，这是处理HTTP请求的入口函数
 */
 void http_conn::process()
 {
-    HTTP_CODE read_ret = process_read();
-    if (read_ret == NO_REQUEST)   // 没有读到完整行，返回等待剩余数据
+    // 任务排队期间连接已被关闭，丢弃过期的任务
+    if (m_sockfd != -1)
     {
-        return;
+        if (m_queued_at != 0)
+        {
+            m_parse_begin = latency_stats::now();
+            latency_stats::record(latency_stats::QUEUE_WAIT, m_parse_begin - m_queued_at);
+            m_queued_at = 0;
+        }
+        set_state(CONN_PROCESSING);
+        while (process_requests() == PROCESS_WAIT)
+        {
+            // 请求不完整，交还给事件循环线程
+            int expected = CONN_PROCESSING;
+            if (m_state.compare_exchange_strong(expected, CONN_IDLE, std::memory_order_acq_rel))
+            {
+                break;
+            }
+            // 处理期间又有数据到来，可读事件已被合并，由本线程继续读取
+            m_state.fetch_and(~STATE_PENDING, std::memory_order_acq_rel);
+            if (!read())
+            {
+                close_conn();
+                break;
+            }
+        }
     }
+    release();
+}
 
-    // 构造HTTP回复报文
-    bool write_ret = process_write(read_ret);
-    if (!write_ret)     // 构建失败，关闭连接，释放资源
+/**
+ * 由事件循环线程在读取数据后调用，此时连接处于CONN_QUEUED状态。
+ * 目标文件都在缓存中时直接构造响应，省去任务入队、唤醒工作线程和跨线程注册事件；
+ * 遇到未缓存的文件时已排队的响应保留，从该请求开始交给工作线程
+*/
+bool http_conn::process_inline()
+{
+    set_state(CONN_PROCESSING);
+    m_cache_only = true;
+    PROCESS_RESULT ret = process_requests();
+    m_cache_only = false;
+    if (ret == PROCESS_DEFER)
     {
-        close_conn();
-        return;
+        set_state(CONN_QUEUED);
+        return false;
+    }
+    if (ret == PROCESS_WAIT)
+    {
+        // 在事件循环线程中，期间不会有新的可读事件被合并
+        set_state(CONN_IDLE);
+    }
+    return true;
+}
+
+/**
+ * 连接不空闲时只记录可读事件，由当前持有连接的一方处理，保证同一连接只有一个任务在排队或处理
+*/
+bool http_conn::try_queue()
+{
+    int state = m_state.load(std::memory_order_acquire);
+    while (true)
+    {
+        int next = (state == CONN_IDLE) ? CONN_QUEUED : (state | STATE_PENDING);
+        if (m_state.compare_exchange_weak(state, next, std::memory_order_acq_rel))
+        {
+            return state == CONN_IDLE;
+        }
+    }
+}
+
+/**
+ * 修改连接状态，保留STATE_PENDING标志
+*/
+void http_conn::set_state(int state)
+{
+    int old = m_state.load(std::memory_order_relaxed);
+    while (!m_state.compare_exchange_weak(old, (old & STATE_PENDING) | state, std::memory_order_acq_rel))
+    {
+    }
+}
+
+/**
+ * 超时回调，工作线程持有连接时不能关闭，返回false由时间轮在下一个tick再次检查
+*/
+bool http_conn::timeout()
+{
+    int state = m_state.load(std::memory_order_acquire) & STATE_MASK;
+    if (state == CONN_QUEUED || state == CONN_PROCESSING)
+    {
+        return false;
+    }
+    close_conn();
+    return true;
+}
+
+/**
+ * 依次处理读缓冲区中的请求，返回PROCESS_WAIT表示请求不完整、需要等待更多数据，
+ * PROCESS_DONE表示响应已交给可写事件发送或连接已关闭，PROCESS_DEFER表示需要交给工作线程打开文件
+*/
+http_conn::PROCESS_RESULT http_conn::process_requests()
+{
+    // 依次处理读缓冲区中流水线的多个请求，响应排队后合并发送
+    // 事件循环线程中已排队的响应保留，由工作线程继续处理之后的请求
+    // 剩余的数据段不够一个多范围响应时，之后的请求在发送完毕后处理
+    while (m_response_count < MAX_PIPELINE && m_segment_count + MAX_RESPONSE_SEGMENTS <= MAX_SEGMENTS)
+    {
+        HTTP_CODE read_ret = NO_REQUEST;
+        if (m_lookup_pending)   // 请求已解析完毕，只差打开目标文件
+        {
+            m_lookup_pending = false;
+            read_ret = do_request();
+        }
+        else
+        {
+            m_lookup_begin = 0;
+            read_ret = process_read();
+            if (read_ret != NO_REQUEST)
+            {
+                // 没有查找文件的请求（如格式错误）以当前时刻作为解析结束
+                uint64_t end = m_lookup_begin ? m_lookup_begin : latency_stats::now();
+                latency_stats::record(latency_stats::PARSE, end - m_parse_begin);
+            }
+        }
+        if (read_ret == NO_REQUEST)   // 没有读到完整请求，等待剩余数据
+        {
+            break;
+        }
+        if (read_ret == CACHE_MISS)
+        {
+            m_lookup_pending = true;
+            return PROCESS_DEFER;
+        }
+        if (read_ret == BAD_REQUEST)    // 请求格式错误，无法确定下一个请求的位置，响应后关闭连接
+        {
+            m_linger = false;
+        }
+
+        // 构造HTTP回复报文
+        bool write_ret = process_write(read_ret);
+        if (!write_ret)     // 构建失败，关闭连接，释放资源
+        {
+            close_conn();
+            return PROCESS_DONE;
+        }
+        ++m_response_count;
+
+        // 跳过正文，移到下一个请求的起始位置
+        if (m_check_state == CHECK_STATE_CONTENT)
+        {
+            m_checked_idx += m_content_length;
+        }
+        m_start_line = m_checked_idx;
+        m_request_start = m_checked_idx;
+        if (!m_linger)
+        {
+            m_close_after_write = true;
+            break;
+        }
+        init_request();
+        if (m_checked_idx < m_read_idx)     // 流水线中的下一个请求已读入
+        {
+            m_parse_begin = latency_stats::now();
+        }
+    }
+    if (m_response_count == 0)
+    {
+        // 继续等待请求的剩余部分
+        m_timer.expire.store(m_deadline, std::memory_order_relaxed);
+        return PROCESS_WAIT;
     }
 
+    // 注册可写事件之后事件循环线程可能立即发送完毕并重设超时和状态，必须在此之前设置
+    m_timer.expire.store(deadline(m_write_timeout), std::memory_order_relaxed);
+    set_state(CONN_WRITING);
     // 注销读事件，注册可写事件
-    event_del(read_ev);
-    event_add(write_ev, NULL);
+    event_del(&read_ev);
+    event_add(&write_ev, NULL);
+    return PROCESS_DONE;
 }
 
@@ -16,11 +16,21 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <sys/mman.h>
+#include <sys/sendfile.h>
 #include <stdarg.h>
 #include <errno.h>
 #include <event.h>
 
 #include "locker.h"
+#include "file_cache.h"
+#include "buffer_pool.h"
+#include "http_scan.h"
+#include "timer_wheel.h"
+#include "conn_table.h"
+#include "latency_stats.h"
+#include "server_metrics.h"
+#include "logger.h"
+#include "http_response.h"
 
 /**
  * HTTP任务类
@@ -28,41 +38,57 @@
 class http_conn
 {
 public:
-    static const int FILENAME_LEN = 200;
-    static const int READ_BUFFER_SIZE = 2048;
-    static const int WRITE_BUFFER_SIZE = 1024;
+    static const int FILENAME_LEN = 200;    // 目标文件完整路径的最大长度
+    static const int READ_BUFFER_SIZE = 1024;   // 读缓冲区初始大小，不够时成倍增长到m_read_buffer_limit
+    static const int WRITE_BUFFER_SIZE = 1024;  // 写缓冲区初始大小，流水线请求的响应头部较多时成倍增长
+    static const int WRITE_BUFFER_LIMIT = 64 * 1024;    // 写缓冲区的最大大小
+    static const int MAX_PIPELINE = 16;     // 一次合并发送的最大响应数
+    static const int MAX_RANGES = 8;        // 一个请求最多处理的字节范围数，超过时忽略Range发送整个文件
     enum METHOD { GET = 0, POST, HEAD, PUT, DELETE, TRACE, OPTIONS, CONNECT, PATCH };   // 请求方法
     enum CHECK_STATE { CHECK_STATE_REQUESTLINE = 0, CHECK_STATE_HEADER, CHECK_STATE_CONTENT };  // 主状态机：解析请求行、解析请求头部、解析正文
-    enum HTTP_CODE { NO_REQUEST, GET_REQUEST, BAD_REQUEST, NO_RESOURCE, FORBIDDEN_REQUEST, FILE_REQUEST, INTERNAL_ERROR, CLOSED_CONNECTION };   // 解析结果
+    enum HTTP_CODE { NO_REQUEST, GET_REQUEST, BAD_REQUEST, NO_RESOURCE, FORBIDDEN_REQUEST, FILE_REQUEST, INTERNAL_ERROR, CLOSED_CONNECTION, CACHE_MISS, STATS_REQUEST };  // 解析结果，CACHE_MISS表示目标文件需要交给工作线程打开，STATS_REQUEST表示请求延迟统计或服务器计数器
     enum LINE_STATUS { LINE_OK = 0, LINE_BAD, LINE_OPEN };  // 从状态机：读取到一个完整行、行错误、行不完整
 
 public:
-    http_conn() {}
+    http_conn() : m_sockfd(-1), m_read_buf(nullptr), m_read_buf_size(0),
+                  m_write_buf(nullptr), m_write_buf_size(0), m_file(nullptr), m_wheel(nullptr),
+                  m_handle(0), m_refs(0), m_state(CONN_IDLE)
+    {
+        m_timer.data = this;
+    }
     ~http_conn()
     {
-        if (read_ev != nullptr)
-        {
-            event_free(read_ev);
-            read_ev = nullptr;
-        }
-        if (write_ev != nullptr)
-        {
-            event_free(write_ev);
-            write_ev = nullptr;
-        }
+        free_buffers();
     }
 
 public:
-    void init(int sockfd, const sockaddr_in& addr, struct event* rev, struct event* wev);   // 初始化新接受的连接
+    void init(int sockfd, const sockaddr_in& addr, struct event_base* base,
+              event_callback_fn read_cb, event_callback_fn write_cb, timer_wheel* wheel);   // 初始化新接受的连接
     void close_conn();  // 关闭连接
-    void process();     // 处理HTTP请求的入口函数
+    void process();     // 处理HTTP请求的入口函数，处理完毕后释放add_ref()获得的引用
+    bool process_inline();  // 在事件循环线程中处理目标文件已缓存的请求，返回false表示需要交给process()
+    uint64_t handle() const { return m_handle.load(std::memory_order_relaxed); }   // 连接在连接表中的句柄
+    void add_ref() { m_refs.fetch_add(1, std::memory_order_relaxed); }    // 交给process()处理前为任务增加引用
+    void release();     // 释放引用，连接已关闭且没有引用时归还给连接表
     bool read();    // 非阻塞读HTTP请求报文
     bool write();   // 非阻塞写HTTP响应
+    bool try_queue();   // 可读事件到来时由事件循环线程调用，返回true表示连接空闲、可以读取并交给process()
+    void pause_timer();     // 交给process()处理前暂停超时计时，由事件循环线程调用
+    void mark_queued() { m_queued_at = m_read_stamp; }  // 交给线程池前调用，从读完数据开始计算排队时间
+    bool timeout();     // 超时回调，返回true表示连接已关闭
 
 private:
-    void init();    // 初始化HTTP请求解析状态变量
+    friend class conn_table;
+    friend struct reset_bench;  // 基准测试直接调用请求结束和关闭连接时的重置函数
+
+    void init();    // 初始化连接的解析和发送状态
+    void init_request();    // 初始化单个HTTP请求的解析状态变量，流水线中每个请求开始前调用
+    enum PROCESS_RESULT { PROCESS_WAIT = 0, PROCESS_DONE, PROCESS_DEFER };  // 等待更多数据、已交给可写事件或已关闭、需要交给工作线程
+    PROCESS_RESULT process_requests();  // 依次处理读缓冲区中的请求
+    void set_state(int state);  // 修改连接状态
     HTTP_CODE process_read();   // 解析HTTP请求
     bool process_write(HTTP_CODE ret);  // 决定返回给客户端的内容
+    bool write_done();      // HTTP响应发送完毕，决定保持还是关闭连接
 
     /**** 下面一组函数由process_read()调用以解析HTTP请求 ****/
     HTTP_CODE parse_request_line( char* text );     // 解析请求行
@@ -71,49 +97,137 @@ private:
     HTTP_CODE do_request();     // 分析目标文件
     char* get_line() { return m_read_buf + m_start_line; }  // 得到行的起始地址
     LINE_STATUS parse_line();   // 解析得到一行数据
+    bool grow_read_buf();   // 扩大读缓冲区
+    void relocate_request(char* buf, int shift);    // 读缓冲区内容移动后，修正已解析出的请求行指针
+    void free_buffers();    // 将读写缓冲区归还给缓冲区池
+    unsigned deadline(int seconds);     // seconds秒后到期的tick
+    void arm_timer(unsigned expire);    // 设置超时时间，由事件循环线程调用
 
     /**** 下面一组函数由process_write()调用以填充HTTP响应 ****/
-    void unmap();   // 对内存映射区执行munmap操作
-    bool add_response(const char* format, ...);     // 构造HTTP相应内容
-    bool add_content(const char* content);  // 添加正文内容
-    bool add_status_line(int status, const char* title);    // 添加状态行
-    bool add_headers(int content_length);   // 添加头部
-    bool add_content_length(int content_length);    // 添加Content-Length字段到头部
-    bool add_linger();  // 添加Connection字段到头部
-    bool add_blank_line();  // 添加一个空行
+    void unmap();   // 释放目标文件缓存项的引用
+    bool grow_write_buf();  // 扩大写缓冲区
+    void add_segment(int type, const char* addr, int fd, off_t offset, off_t len);    // 添加待发送的数据段
+    template<typename... Parts>
+    bool add_parts(const Parts&... parts);  // 把报文片段拼接到写缓冲区，只检查一次空间
+    bool add_static(http_response::STATIC_RESPONSE response);   // 预先生成的响应，中间插入Date行
+    bool not_modified(const file_entry* file) const;    // 条件请求的验证器与文件一致，应返回304
+    struct byte_range
+    {
+        off_t first;    // 起始偏移
+        off_t len;      // 字节数
+    };
+    int parse_range(off_t size, byte_range* ranges) const;  // 解析Range头部，返回可满足的范围数，-1表示忽略Range
+    bool if_range_matches(const file_entry* file) const;    // If-Range与文件一致或不存在时按Range响应
+    bool add_ranges(const byte_range* ranges, int count);   // 206响应，单个范围或multipart/byteranges
+    void add_body(off_t offset, off_t len);     // 添加目标文件的一段作为正文
 
 public:
     static struct event_base* base;
-    static int m_user_count;    // 统计用户数量
+    static bool m_use_sendfile; // 是否使用sendfile发送文件正文，启动时设置
+    static int m_read_buffer_limit; // 读缓冲区的最大大小，即允许的最大请求头部长度
+    // 超时时间（秒），为0时不超时
+    static int m_header_timeout;    // 从请求的第一个字节到读完头部
+    static int m_body_timeout;      // 读完头部到读完正文
+    static int m_keepalive_timeout; // 长连接两个请求之间的空闲时间
+    static int m_write_timeout;     // 发送响应时两次写入进展之间的时间
+    static bool m_inline;   // 线程池模式下是否在事件循环线程中直接处理命中文件缓存的请求
+    static const char* m_doc_root;  // 资源根目录，长度不超过FILENAME_LEN的一半
 
 private:
+    // 连接的所有权状态，保证同一时刻只有一个线程操作连接
+    enum CONN_STATE
+    {
+        CONN_IDLE = 0,      // 空闲，由事件循环线程持有，等待可读事件
+        CONN_QUEUED,        // 已读取数据并交给process()，等待工作线程处理
+        CONN_PROCESSING,    // 工作线程正在解析请求
+        CONN_WRITING        // 响应已排队，由事件循环线程在可写事件中发送
+    };
+    static const int STATE_MASK = 3;
+    static const int STATE_PENDING = 4;     // 非空闲期间又有可读事件到来，由持有连接的一方继续读取
+
+    // 待发送的数据段，多个流水线请求的响应依次排列，由write()合并发送
+    enum SEGMENT_TYPE { SEG_BUF = 0, SEG_MEM, SEG_FILE };  // 写缓冲区中的数据、外部内存（mmap的文件）、通过sendfile发送的文件
+    struct segment
+    {
+        int type;
+        const char* addr;   // SEG_MEM的起始地址
+        int fd;             // SEG_FILE的文件描述符
+        off_t offset;       // SEG_BUF为在写缓冲区中的偏移，SEG_FILE为文件偏移
+        off_t len;          // 剩余待发送的字节数
+    };
+    static const int MAX_RESPONSE_SEGMENTS = MAX_RANGES * 2 + 2;   // 一个响应最多的数据段数（多范围响应）
+    static const int MAX_SEGMENTS = (MAX_PIPELINE - 1) * 2 + MAX_RESPONSE_SEGMENTS;    // 其他响应最多两个数据段
+
     int m_sockfd;               // 该HTTP连接的socket
     sockaddr_in m_address;      // 对方的socket地址
-    struct event* read_ev;      // 读事件处理器
-    struct event* write_ev;     // 可写事件处理器
+    struct event read_ev;       // 读事件处理器，内嵌在连接中，每个连接通过event_assign()重新设置，不分配内存
+    struct event write_ev;      // 可写事件处理器
 
-    char m_read_buf[READ_BUFFER_SIZE];    // 读缓冲区
+    char* m_read_buf;   // 读缓冲区，从缓冲区池按需分配，连接空闲或关闭时归还
+    int m_read_buf_size;    // 读缓冲区的容量
     int m_read_idx;     // 标识读缓冲区中已经读入数据的最后一个字节的下一个位置
     int m_checked_idx;  // 当前正在分析的字符在读缓冲区中的位置
     int m_start_line;   // 当前正在解析的行的起始地址
-    char m_write_buf[WRITE_BUFFER_SIZE];    // 写缓冲区
-    int m_write_idx;    // 写缓冲区待发送的字节数
+    int m_request_start;    // 当前请求在读缓冲区中的起始位置，之前的请求都已处理
+    char* m_write_buf;  // 写缓冲区，构造响应时从缓冲区池分配
+    int m_write_buf_size;   // 写缓冲区的容量
+    int m_write_idx;    // 写缓冲区已写入的字节数
 
     CHECK_STATE m_check_state;      // 主状态机当前所处的状态
     METHOD m_method;    // HTTP请求方法
 
-    char m_real_file[FILENAME_LEN];     // 客户请求目标文件的完整路径
     char* m_url;    // 请求文件名
     char* m_version;    // HTTP版本
     char* m_host;       // 主机名
-    int m_content_length;   // 正文长度
+    char* m_if_none_match;      // If-None-Match的值
+    char* m_if_modified_since;  // If-Modified-Since的值
+    char* m_range;      // Range的值
+    char* m_if_range;   // If-Range的值
+    int m_content_length;   // 正文长度，-1表示没有Content-Length头部
     bool m_linger;      // HTTP请求是否要求保持连接
 
-    char* m_file_address;   // 客户请求的目标文件被mmap到内存中的起始地址
-    struct stat m_file_stat;    // 目标文件的状态
-    struct iovec m_iv[2];   // 用于writev写操作
-    int m_iv_count;
+    file_entry* m_file;     // 客户请求的目标文件，包含文件状态和mmap到内存中的起始地址
+    file_entry* m_files[MAX_PIPELINE];  // 已排队的响应引用的文件，发送完毕后释放
+    int m_file_count;
+    segment m_segments[MAX_SEGMENTS];   // 待发送的数据段
+    int m_segment_count;
+    int m_segment_idx;      // 下一个待发送的数据段
+    int m_response_count;   // 已排队的响应数
+    bool m_close_after_write;   // 已排队的响应中有要求关闭连接的，发送完毕后关闭
+
+    timer_wheel* m_wheel;   // 连接所属事件循环的时间轮
+    timer_node m_timer;     // 连接在时间轮中的节点
+    unsigned m_deadline;    // 当前读阶段（头部、正文或长连接空闲）的到期tick
+    bool m_idle;            // 长连接空闲，等待下一个请求的第一个字节
+    bool m_cache_only;      // 在事件循环线程中处理，do_request()只查找文件缓存
+    bool m_lookup_pending;  // 已解析的请求在事件循环线程中未命中缓存，由工作线程继续do_request()
+
+    // 请求阶段的时间戳，单位为latency_stats::now()的tick，相邻阶段共用时间戳以减少读时钟的次数
+    uint64_t m_read_stamp;  // 最近一次read()读完数据的时刻
+    uint64_t m_queued_at;   // 交给线程池的时刻，多reactor模式下为0
+    uint64_t m_request_begin;   // 读到当前这批请求第一批数据的时刻
+    uint64_t m_parse_begin;     // 下一个请求开始解析的时刻
+    uint64_t m_lookup_begin;    // 开始查找目标文件的时刻，即解析结束的时刻
+
+    std::atomic<uint64_t> m_handle;     // 高32位为代数，低32位为槽位下标，关闭时代数加一
+    std::atomic<int> m_refs;    // 连接打开时持有一个引用，每个排队的任务、时间轮节点和工作线程关闭连接时的cancel()各持有一个引用
+    std::atomic<int> m_state;   // CONN_STATE加上STATE_PENDING标志
 };
 
+template<typename... Parts>
+bool http_conn::add_parts(const Parts&... parts)
+{
+    int len = http_response::max_len(parts...);
+    while (m_write_idx + len > m_write_buf_size)
+    {
+        if (!grow_write_buf())
+        {
+            return false;
+        }
+    }
+    m_write_idx += http_response::build(m_write_buf + m_write_idx, parts...);
+    return true;
+}
+
 #endif
 
@@ -0,0 +1,204 @@
+#include "http_response.h"
+
+#include <unistd.h>
+#include <sys/time.h>
+#include <event.h>
+
+/**** HTTP响应内容，长度在编译期确定 ****/
+struct status_response
+{
+    uint64_t status;
+    http_response::block title;
+    http_response::block form;
+};
+static constexpr status_response responses[http_response::STATIC_RESPONSE_COUNT] = {
+    { 400, "Bad Request", "Your request has bad syntax or is inherently impossible to satisfy.\n" },
+    { 403, "Forbidden", "You do not have permission to get file from this server.\n" },
+    { 404, "Not Found", "The requested file was not found on this server.\n" },
+    { 500, "Internal Error", "There was an unusual problem serving the requested file.\n" },
+};
+
+static constexpr char status_200[] = "HTTP/1.1 200 OK\r\n";
+static constexpr char content_length[] = "Content-Length: ";
+static constexpr char etag[] = "ETag: \"";
+static constexpr char last_modified[] = "Last-Modified: ";
+static_assert(sizeof(status_200) - 1 + sizeof(content_length) - 1 + http_response::UINT_LEN + 2
+              + sizeof(etag) - 1 + http_response::UINT_LEN * 3 + 5
+              + sizeof(last_modified) - 1 + http_response::HTTP_DATE_LEN + 2 <= http_response::FILE_HEADER_LEN,
+              "FILE_HEADER_LEN too small");
+
+std::atomic<unsigned> http_response::s_date_seq(0);
+std::atomic<uint64_t> http_response::s_date[http_response::DATE_WORDS];
+
+// 00到99的两位数字
+static constexpr char digit_pairs[] =
+    "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+    "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+    "8081828384858687888990919293949596979899";
+
+http_response* http_response::instance()
+{
+    static http_response response;
+    return &response;
+}
+
+/**
+ * Date行插在Content-Length和Connection之间，因此每个响应分为两块生成
+*/
+http_response::http_response() : m_date_ev(nullptr)
+{
+    int len = 0;
+    for (int i = 0; i < STATIC_RESPONSE_COUNT; ++i)
+    {
+        const status_response& r = responses[i];
+        int n = build(m_buf + len, "HTTP/1.1 ", r.status, " ", r.title, "\r\n", content_length, (uint64_t)r.form.len, "\r\n");
+        m_head[i] = block(m_buf + len, n);
+        len += n;
+        for (int keepalive = 0; keepalive < 2; ++keepalive)
+        {
+            n = build(m_buf + len, connection(keepalive), r.form);
+            m_tail[i][keepalive] = block(m_buf + len, n);
+            len += n;
+        }
+    }
+    update_date(time(nullptr));
+
+    // 分隔符不能出现在文件内容中，由启动时间和进程号生成，减少与内容碰撞的可能
+    int n = build(m_boundary_buf, "range_", ((uint64_t)time(nullptr) << 20) ^ (uint64_t)getpid());
+    m_boundary = block(m_boundary_buf, n);
+}
+
+void http_response::attach(struct event_base* base)
+{
+    update_date(time(nullptr));
+    m_date_ev = event_new(base, -1, 0, date_cb, this);
+    schedule_date();
+}
+
+/**
+ * 定时器对齐到秒的边界；提前触发时time()仍是上一秒，剩余的几微秒后再触发一次
+*/
+void http_response::schedule_date()
+{
+    struct timeval now;
+    gettimeofday(&now, nullptr);
+    struct timeval interval = { 0, 1000000 - now.tv_usec };
+    event_add(m_date_ev, &interval);
+}
+
+void http_response::date_cb(int fd, short events, void* arg)
+{
+    http_response* response = (http_response*)arg;
+    update_date(time(nullptr));
+    response->schedule_date();
+}
+
+/**
+ * seqlock写入：序号为奇数期间读者重试
+*/
+void http_response::update_date(time_t now)
+{
+    char line[DATE_WORDS * 8] = {};
+    memcpy(line, "Date: ", 6);
+    format_date(line + 6, now);
+    memcpy(line + DATE_LINE_LEN - 2, "\r\n", 2);
+
+    uint64_t words[DATE_WORDS];
+    memcpy(words, line, sizeof(words));
+    unsigned seq = s_date_seq.load(std::memory_order_relaxed);
+    s_date_seq.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    for (int i = 0; i < DATE_WORDS; ++i)
+    {
+        s_date[i].store(words[i], std::memory_order_relaxed);
+    }
+    s_date_seq.store(seq + 2, std::memory_order_release);
+}
+
+const http_response::block& http_response::connection(bool keepalive)
+{
+    static constexpr block blocks[2] = { "Connection: close\r\n\r\n", "Connection: keep-alive\r\n\r\n" };
+    return blocks[keepalive];
+}
+
+const http_response::block& http_response::stats_header()
+{
+    static constexpr block header = "HTTP/1.1 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\n";
+    return header;
+}
+
+const http_response::block& http_response::not_modified()
+{
+    static constexpr block status = "HTTP/1.1 304 Not Modified\r\n";
+    return status;
+}
+
+const http_response::block& http_response::partial_content()
+{
+    static constexpr block status = "HTTP/1.1 206 Partial Content\r\n";
+    return status;
+}
+
+const http_response::block& http_response::range_not_satisfiable()
+{
+    static constexpr block status = "HTTP/1.1 416 Range Not Satisfiable\r\n";
+    return status;
+}
+
+/**
+ * ETag由inode、纳秒精度的修改时间和文件大小组成，文件被替换或修改后随之改变
+*/
+int http_response::file_header(char* buf, const struct stat& st, validators* v)
+{
+    int len = build(buf, status_200, content_length, (uint64_t)st.st_size, "\r\n");
+    char* lines = buf + len;
+    len += build(buf + len, etag);
+    char* tag = buf + len - 1;
+    len += build(buf + len, (uint64_t)st.st_ino, "-",
+                 (uint64_t)st.st_mtim.tv_sec * 1000000000ull + st.st_mtim.tv_nsec, "-", (uint64_t)st.st_size, "\"");
+    v->etag = block(tag, buf + len - tag);
+    len += build(buf + len, "\r\n", last_modified);
+    v->last_modified = block(buf + len, HTTP_DATE_LEN);
+    len += format_date(buf + len, st.st_mtim.tv_sec);
+    len += build(buf + len, "\r\n");
+    v->lines = block(lines, buf + len - lines);
+    return len;
+}
+
+int http_response::format_date(char* buf, time_t t)
+{
+    struct tm tm;
+    gmtime_r(&t, &tm);
+    return strftime(buf, HTTP_DATE_LEN + 1, "%a, %d %b %Y %H:%M:%S GMT", &tm);
+}
+
+/**
+ * 先数出位数，再从低位起每次用查表写两位
+*/
+int http_response::format_uint(char* buf, uint64_t value)
+{
+    int n = 1;
+    for (uint64_t bound = 10; n < UINT_LEN && value >= bound; bound *= 10)
+    {
+        ++n;
+    }
+    char* p = buf + n;
+    while (value >= 100)
+    {
+        int i = (int)(value % 100) * 2;
+        value /= 100;
+        *--p = digit_pairs[i + 1];
+        *--p = digit_pairs[i];
+    }
+    if (value >= 10)
+    {
+        int i = (int)value * 2;
+        *--p = digit_pairs[i + 1];
+        *--p = digit_pairs[i];
+    }
+    else
+    {
+        *--p = '0' + (int)value;
+    }
+    return n;
+}
@@ -0,0 +1,159 @@
+#ifndef HTTP_RESPONSE_H
+#define HTTP_RESPONSE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <atomic>
+
+struct event_base;
+struct event;
+
+/**
+ * 预先生成的响应
+ * 错误响应（400/403/404/500）在启动时生成状态行和Content-Length，以及Connection行和正文
+ * （长连接和非长连接各一份）；文件响应的状态行、Content-Length、ETag和Last-Modified在打开文件时生成并保存在file_entry中，
+ * 304响应复用其中的ETag和Last-Modified行。
+ * 构造响应时复制这些报文块，中间插入缓存的Date行。
+ * 报文由build()从片段拼接：字符串常量的长度在编译期确定，整数用两位一组的查表法格式化，
+ * 调用者先用max_len()得到整个报文的最大长度，只检查一次缓冲区空间。
+ * Date行由事件循环上的定时器在每秒开始时生成，以seqlock保护，其他线程读取时只复制37个字节
+*/
+class http_response
+{
+public:
+    enum STATIC_RESPONSE { RESPONSE_400 = 0, RESPONSE_403, RESPONSE_404, RESPONSE_500, STATIC_RESPONSE_COUNT };
+    static const int FILE_HEADER_LEN = 192; // 文件响应头部的最大长度
+    static const int UINT_LEN = 20;         // 64位无符号整数的最大位数
+    static const int HTTP_DATE_LEN = 29;    // IMF-fixdate格式日期的长度
+    static const int DATE_LINE_LEN = 37;    // "Date: "加日期加"\r\n"
+
+    // 一段不可变的报文，从字符串常量构造时长度取自数组大小
+    struct block
+    {
+        const char* data;
+        int len;
+
+        block() : data(nullptr), len(0) {}
+        constexpr block(const char* d, int l) : data(d), len(l) {}
+        template<size_t N>
+        constexpr block(const char (&s)[N]) : data(s), len(N - 1) {}
+    };
+    struct date_part {};    // 表示Date行的片段
+
+    // 文件的验证器，指向file_header()生成的头部
+    struct validators
+    {
+        block lines;    // ETag行和Last-Modified行，304响应直接复制
+        block etag;     // ETag的值，包含引号
+        block last_modified;    // Last-Modified的值
+    };
+
+public:
+    static http_response* instance();
+    const block& head(STATIC_RESPONSE response) const { return m_head[response]; }     // 状态行和Content-Length行
+    const block& tail(STATIC_RESPONSE response, bool keepalive) const { return m_tail[response][keepalive]; }   // Connection行、空行和正文
+    void attach(struct event_base* base);   // 生成Date行，并在事件循环上每秒刷新
+    static void update_date(time_t now);    // 生成now时刻的Date行，只能由一个线程调用
+    static date_part date() { return date_part(); }
+    static const block& connection(bool keepalive);     // Connection行和头部结束的空行
+    static const block& stats_header();     // 统计报文的状态行和Content-Type
+    static const block& not_modified();     // 304状态行
+    static const block& partial_content();  // 206状态行
+    static const block& range_not_satisfiable();    // 416状态行
+    const block& boundary() const { return m_boundary; }    // multipart/byteranges响应的分隔符，进程内固定
+    // 写入200状态行、Content-Length、ETag和Last-Modified行，buf至少FILE_HEADER_LEN字节
+    static int file_header(char* buf, const struct stat& st, validators* v);
+    static int format_uint(char* buf, uint64_t value);      // 十进制格式化，不写结束符，buf至少UINT_LEN字节
+    static int format_date(char* buf, time_t t);    // IMF-fixdate格式，不写结束符，buf至少HTTP_DATE_LEN + 1字节
+
+    // 片段依次为字符串常量、block、无符号整数或date()
+    template<typename... Parts>
+    static int max_len(const Parts&... parts);  // 拼接后的最大长度
+    template<typename... Parts>
+    static int build(char* buf, const Parts&... parts);     // 拼接到buf，返回长度，buf至少max_len()字节
+
+private:
+    http_response();
+    http_response(const http_response&);
+    http_response& operator=(const http_response&);
+
+    template<size_t N>
+    static constexpr int part_len(const char (&)[N]) { return N - 1; }
+    static int part_len(const block& b) { return b.len; }
+    static int part_len(uint64_t) { return UINT_LEN; }
+    static int part_len(date_part) { return DATE_LINE_LEN; }
+
+    template<size_t N>
+    static char* put(char* p, const char (&s)[N])
+    {
+        memcpy(p, s, N - 1);    // 长度是常量，编译为定长复制
+        return p + N - 1;
+    }
+    static char* put(char* p, const block& b)
+    {
+        memcpy(p, b.data, b.len);
+        return p + b.len;
+    }
+    static char* put(char* p, uint64_t value) { return p + format_uint(p, value); }
+    static char* put(char* p, date_part);
+    static void date_cb(int fd, short events, void* arg);
+    void schedule_date();   // 在下一秒开始时刷新Date行
+
+private:
+    static const int DATE_WORDS = (DATE_LINE_LEN + 7) / 8;
+    static std::atomic<unsigned> s_date_seq;    // 为奇数时正在更新
+    static std::atomic<uint64_t> s_date[DATE_WORDS];    // Date行，按8字节存放以便无数据竞争地读取
+    block m_head[STATIC_RESPONSE_COUNT];
+    block m_tail[STATIC_RESPONSE_COUNT][2];     // 第二维下标为是否长连接
+    char m_buf[2048];   // m_head和m_tail指向的报文
+    block m_boundary;
+    char m_boundary_buf[32];
+    struct event* m_date_ev;
+};
+
+/**
+ * seqlock读取：复制期间Date行被更新时重新读取
+*/
+inline char* http_response::put(char* p, date_part)
+{
+    uint64_t words[DATE_WORDS];
+    unsigned seq;
+    do
+    {
+        seq = s_date_seq.load(std::memory_order_acquire);
+        for (int i = 0; i < DATE_WORDS; ++i)
+        {
+            words[i] = s_date[i].load(std::memory_order_relaxed);
+        }
+        std::atomic_thread_fence(std::memory_order_acquire);
+    } while ((seq & 1) || seq != s_date_seq.load(std::memory_order_relaxed));
+    memcpy(p, words, DATE_LINE_LEN);
+    return p + DATE_LINE_LEN;
+}
+
+template<typename... Parts>
+int http_response::max_len(const Parts&... parts)
+{
+    int lens[] = { 0, part_len(parts)... };
+    int len = 0;
+    for (size_t i = 0; i < sizeof(lens) / sizeof(lens[0]); ++i)
+    {
+        len += lens[i];
+    }
+    return len;
+}
+
+template<typename... Parts>
+int http_response::build(char* buf, const Parts&... parts)
+{
+    char* p = buf;
+    int expand[] = { 0, (p = put(p, parts), 0)... };
+    (void)expand;
+    return p - buf;
+}
+
+#endif
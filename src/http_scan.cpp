@@ -0,0 +1,144 @@
+#include "http_scan.h"
+
+#include <assert.h>
+#include <string.h>
+#include <strings.h>
+#include <immintrin.h>
+
+const char* find_either_scalar(const char* begin, const char* end, char c1, char c2)
+{
+    for ( ; begin < end; ++begin)
+    {
+        if (*begin == c1 || *begin == c2)
+        {
+            break;
+        }
+    }
+    return begin;
+}
+
+/**
+ * SSE4.2实现：pcmpestri一次在16个字节中查找任一目标字符
+*/
+__attribute__((target("sse4.2")))
+const char* find_either_sse42(const char* begin, const char* end, char c1, char c2)
+{
+    const __m128i targets = _mm_setr_epi8(c1, c2, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+    for ( ; end - begin >= 16; begin += 16)
+    {
+        __m128i data = _mm_loadu_si128((const __m128i*)begin);
+        int idx = _mm_cmpestri(targets, 2, data, 16, _SIDD_UBYTE_OPS | _SIDD_CMP_EQUAL_ANY);
+        if (idx != 16)
+        {
+            return begin + idx;
+        }
+    }
+    return find_either_scalar(begin, end, c1, c2);
+}
+
+/**
+ * AVX2实现：每次比较32个字节，用位掩码定位第一个匹配
+*/
+__attribute__((target("avx2")))
+const char* find_either_avx2(const char* begin, const char* end, char c1, char c2)
+{
+    const __m256i v1 = _mm256_set1_epi8(c1);
+    const __m256i v2 = _mm256_set1_epi8(c2);
+    for ( ; end - begin >= 32; begin += 32)
+    {
+        __m256i data = _mm256_loadu_si256((const __m256i*)begin);
+        __m256i eq = _mm256_or_si256(_mm256_cmpeq_epi8(data, v1), _mm256_cmpeq_epi8(data, v2));
+        unsigned mask = (unsigned)_mm256_movemask_epi8(eq);
+        if (mask != 0)
+        {
+            return begin + __builtin_ctz(mask);
+        }
+    }
+    return find_either_sse42(begin, end, c1, c2);
+}
+
+static find_either_func select_find_either()
+{
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+    {
+        return find_either_avx2;
+    }
+    if (__builtin_cpu_supports("sse4.2"))
+    {
+        return find_either_sse42;
+    }
+    return find_either_scalar;
+}
+
+find_either_func find_either = select_find_either();
+
+const char* find_either_impl_name()
+{
+    if (find_either == find_either_avx2)
+    {
+        return "avx2";
+    }
+    if (find_either == find_either_sse42)
+    {
+        return "sse4.2";
+    }
+    return "scalar";
+}
+
+/**** 头部名称完美哈希表 ****/
+
+struct header_slot
+{
+    const char* name;
+    int len;
+    HEADER_ID id;
+};
+
+static const int HEADER_TABLE_SIZE = 32;
+static header_slot header_table[HEADER_TABLE_SIZE];
+
+// 由长度和首尾字符（转小写）计算哈希，对下面的头部集合无冲突
+static inline unsigned header_hash(const char* name, int len)
+{
+    unsigned first = (unsigned char)name[0] | 0x20;
+    unsigned last = (unsigned char)name[len - 1] | 0x20;
+    return (len * 7 + first + last) & (HEADER_TABLE_SIZE - 1);
+}
+
+static bool build_header_table()
+{
+    static const header_slot headers[] =
+    {
+        { "Connection", 10, HEADER_CONNECTION },
+        { "Content-Length", 14, HEADER_CONTENT_LENGTH },
+        { "Host", 4, HEADER_HOST },
+        { "If-None-Match", 13, HEADER_IF_NONE_MATCH },
+        { "If-Modified-Since", 17, HEADER_IF_MODIFIED_SINCE },
+        { "Range", 5, HEADER_RANGE },
+        { "If-Range", 8, HEADER_IF_RANGE },
+    };
+    for (size_t i = 0; i < sizeof(headers) / sizeof(headers[0]); ++i)
+    {
+        header_slot& slot = header_table[header_hash(headers[i].name, headers[i].len)];
+        assert(slot.name == nullptr);   // 新增头部产生冲突时需要调整header_hash
+        slot = headers[i];
+    }
+    return true;
+}
+
+static bool header_table_ready = build_header_table();
+
+HEADER_ID lookup_header(const char* name, int len)
+{
+    if (len <= 0)
+    {
+        return HEADER_UNKNOWN;
+    }
+    const header_slot& slot = header_table[header_hash(name, len)];
+    if (slot.len == len && strncasecmp(slot.name, name, len) == 0)
+    {
+        return slot.id;
+    }
+    return HEADER_UNKNOWN;
+}
@@ -0,0 +1,36 @@
+#ifndef HTTP_SCAN_H
+#define HTTP_SCAN_H
+
+/**
+ * HTTP请求报文扫描函数
+ * 查找行结束符和头部名称分隔符时每次比较16（SSE4.2）或32（AVX2）个字节，
+ * 启动时根据CPU支持的指令集选择实现，不支持时使用逐字节的标量实现
+*/
+
+// 在[begin, end)中查找第一个等于c1或c2的字符，找不到返回end
+typedef const char* (*find_either_func)(const char* begin, const char* end, char c1, char c2);
+
+extern find_either_func find_either;    // 当前CPU上最快的实现
+
+const char* find_either_scalar(const char* begin, const char* end, char c1, char c2);
+const char* find_either_sse42(const char* begin, const char* end, char c1, char c2);
+const char* find_either_avx2(const char* begin, const char* end, char c1, char c2);
+const char* find_either_impl_name();    // 当前使用的实现名称
+
+// 服务器需要解析的请求头部
+enum HEADER_ID
+{
+    HEADER_UNKNOWN = 0,
+    HEADER_CONNECTION,
+    HEADER_CONTENT_LENGTH,
+    HEADER_HOST,
+    HEADER_IF_NONE_MATCH,
+    HEADER_IF_MODIFIED_SINCE,
+    HEADER_RANGE,
+    HEADER_IF_RANGE
+};
+
+// 通过完美哈希查找头部名称（不含冒号，不区分大小写），一次哈希加一次比较
+HEADER_ID lookup_header(const char* name, int len);
+
+#endif
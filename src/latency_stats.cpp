@@ -0,0 +1,117 @@
+#include "latency_stats.h"
+
+#include <stdio.h>
+
+const char* const latency_stats::STATS_URL = "/__latency";
+thread_local latency_stats::shard* latency_stats::t_shard = nullptr;
+
+latency_stats* latency_stats::instance()
+{
+    static latency_stats stats;
+    return &stats;
+}
+
+latency_stats::latency_stats() : m_ns_per_tick(1), m_merge_ev(nullptr)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    // 对照单调时钟测量TSC频率，只在启动时进行一次
+    struct timespec begin, end;
+    struct timespec interval = { 0, 20 * 1000 * 1000 };
+    clock_gettime(CLOCK_MONOTONIC, &begin);
+    uint64_t tsc_begin = now();
+    nanosleep(&interval, nullptr);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    uint64_t tsc_end = now();
+    double ns = (end.tv_sec - begin.tv_sec) * 1e9 + (end.tv_nsec - begin.tv_nsec);
+    if (tsc_end > tsc_begin)
+    {
+        m_ns_per_tick = ns / (tsc_end - tsc_begin);
+    }
+#endif
+}
+
+latency_stats::~latency_stats()
+{
+    if (m_merge_ev != nullptr)
+    {
+        event_free(m_merge_ev);
+    }
+    for (size_t i = 0; i < m_shards.size(); ++i)
+    {
+        delete m_shards[i];
+    }
+}
+
+void latency_stats::attach(struct event_base* base)
+{
+    struct timeval interval = { MERGE_INTERVAL, 0 };
+    m_merge_ev = event_new(base, -1, EV_PERSIST, merge_cb, this);
+    event_add(m_merge_ev, &interval);
+}
+
+void latency_stats::merge_cb(int fd, short events, void* arg)
+{
+    ((latency_stats*)arg)->merge();
+}
+
+void latency_stats::record(PHASE phase, uint64_t ticks, uint64_t count)
+{
+    shard* s = t_shard ? t_shard : instance()->add_shard();
+    s->phases[phase].record(ticks, count);
+}
+
+latency_stats::shard* latency_stats::add_shard()
+{
+    shard* s = new shard;
+    m_lock.lock();
+    m_shards.push_back(s);
+    m_lock.unlock();
+    t_shard = s;
+    return s;
+}
+
+void latency_stats::merge()
+{
+    m_lock.lock();
+    for (int p = 0; p < PHASE_COUNT; ++p)
+    {
+        m_merged.phases[p].reset();
+        for (size_t i = 0; i < m_shards.size(); ++i)
+        {
+            m_merged.phases[p].add(m_shards[i]->phases[p]);
+        }
+    }
+    m_lock.unlock();
+}
+
+/**
+ * 每个阶段输出为一个summary，单位秒
+*/
+int latency_stats::render(char* buf, int size)
+{
+    static const char* names[PHASE_COUNT] = { "queue_wait", "parse", "lookup", "last_byte" };
+    static const double quantiles[] = { 0.5, 0.9, 0.99, 0.999, 1 };
+    double seconds_per_tick = m_ns_per_tick / 1e9;
+    int len = snprintf(buf, size,
+                       "# HELP http_request_phase_seconds Time spent in each phase of a request.\n"
+                       "# TYPE http_request_phase_seconds summary\n");
+    m_lock.lock();
+    for (int p = 0; p < PHASE_COUNT && len < size; ++p)
+    {
+        const hdr_histogram& h = m_merged.phases[p];
+        for (size_t q = 0; q < sizeof(quantiles) / sizeof(quantiles[0]) && len < size; ++q)
+        {
+            len += snprintf(buf + len, size - len, "http_request_phase_seconds{phase=\"%s\",quantile=\"%g\"} %.9f\n",
+                            names[p], quantiles[q], h.percentile(quantiles[q] * 100) * seconds_per_tick);
+        }
+        if (len < size)
+        {
+            len += snprintf(buf + len, size - len,
+                            "http_request_phase_seconds_sum{phase=\"%s\"} %.9f\n"
+                            "http_request_phase_seconds_count{phase=\"%s\"} %llu\n",
+                            names[p], h.sum() * seconds_per_tick, names[p], (unsigned long long)h.count());
+        }
+    }
+    m_lock.unlock();
+    return len < size ? len : size - 1;
+}
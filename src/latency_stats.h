@@ -0,0 +1,77 @@
+#ifndef LATENCY_STATS_H
+#define LATENCY_STATS_H
+
+#include <stdint.h>
+#include <time.h>
+#include <vector>
+#include <event.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "locker.h"
+#include "hdr_histogram.h"
+
+/**
+ * 请求各阶段的延迟统计
+ * 时间戳使用TSC计数（非x86平台为CLOCK_MONOTONIC纳秒），直方图以tick为单位记录，输出时才换算成秒。
+ * 每个线程第一次记录时注册自己的一组直方图，之后只写本线程的直方图，记录路径上没有锁和原子读改写。
+ * 事件循环上的定时器每秒把所有线程的直方图合并成快照，保留URL STATS_URL以Prometheus文本格式返回快照
+*/
+class latency_stats
+{
+public:
+    enum PHASE
+    {
+        QUEUE_WAIT = 0,     // 从交给线程池到工作线程开始处理
+        PARSE,              // 从读到数据或工作线程开始处理，到开始查找目标文件
+        LOOKUP,             // 查找目标文件
+        LAST_BYTE,          // 从读到请求的第一批数据到响应的最后一个字节写入socket
+        PHASE_COUNT
+    };
+    static const char* const STATS_URL;
+
+public:
+    static latency_stats* instance();
+    void attach(struct event_base* base);   // 在事件循环上注册定时合并
+    void merge();   // 合并各线程的直方图，生成快照
+    int render(char* buf, int size);    // 以Prometheus文本格式输出快照，返回写入的长度
+    double ns_per_tick() const { return m_ns_per_tick; }
+
+    static uint64_t now()   // 当前时间戳，单位为tick
+    {
+#if defined(__x86_64__) || defined(__i386__)
+        return __rdtsc();
+#else
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+#endif
+    }
+    static void record(PHASE phase, uint64_t ticks, uint64_t count = 1);   // 记录到当前线程的直方图
+
+private:
+    latency_stats();
+    ~latency_stats();
+    latency_stats(const latency_stats&);
+    latency_stats& operator=(const latency_stats&);
+
+    static const int MERGE_INTERVAL = 1;    // 合并间隔（秒）
+
+    struct shard
+    {
+        hdr_histogram phases[PHASE_COUNT];
+    };
+    shard* add_shard();     // 为当前线程注册一组直方图
+    static void merge_cb(int fd, short events, void* arg);
+
+private:
+    static thread_local shard* t_shard;
+    double m_ns_per_tick;   // 启动时对照CLOCK_MONOTONIC校准
+    locker m_lock;      // 保护m_shards和快照
+    std::vector<shard*> m_shards;   // 各线程的直方图，线程退出后保留，计数不丢失
+    shard m_merged;     // 最近一次合并的快照
+    struct event* m_merge_ev;
+};
+
+#endif
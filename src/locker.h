@@ -1,9 +1,13 @@
 #ifndef LOCKER_H
 #define LOCKER_H
 
+#include <atomic>
 #include <exception>
 #include <pthread.h>
 #include <semaphore.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
 
 /**** 线程同步机制的包装类 ****/
 
@@ -102,5 +106,46 @@ private:
     pthread_cond_t m_cond;
 };
 
+// 事件计数器，配合无锁队列使用：只有在确实有线程等待时通知方才进行futex系统调用
+// 等待方用法：key = prepare_wait(); 再次检查条件; 条件满足则cancel_wait()，否则wait(key)
+class eventcount
+{
+public:
+    eventcount() : m_epoch(0), m_waiters(0) {}
+    unsigned prepare_wait()
+    {
+        m_waiters.fetch_add(1, std::memory_order_seq_cst);
+        return m_epoch.load(std::memory_order_seq_cst);
+    }
+    void cancel_wait()
+    {
+        m_waiters.fetch_sub(1, std::memory_order_relaxed);
+    }
+    void wait(unsigned key)
+    {
+        // epoch已变化时futex立即返回
+        syscall(SYS_futex, (int*)&m_epoch, FUTEX_WAIT_PRIVATE, key, NULL, NULL, 0);
+        m_waiters.fetch_sub(1, std::memory_order_relaxed);
+    }
+    void notify()
+    {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (m_waiters.load(std::memory_order_relaxed) > 0)
+        {
+            m_epoch.fetch_add(1, std::memory_order_seq_cst);
+            syscall(SYS_futex, (int*)&m_epoch, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+        }
+    }
+    void notify_all()
+    {
+        m_epoch.fetch_add(1, std::memory_order_seq_cst);
+        syscall(SYS_futex, (int*)&m_epoch, FUTEX_WAKE_PRIVATE, 0x7fffffff, NULL, NULL, 0);
+    }
+
+private:
+    std::atomic<unsigned> m_epoch;  // 每次通知递增，作为futex等待的字
+    std::atomic<int> m_waiters;     // 正在等待或准备等待的线程数
+};
+
 #endif
 
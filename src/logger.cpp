@@ -0,0 +1,289 @@
+#include "logger.h"
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <strings.h>
+#include <sys/syscall.h>
+
+static const char* level_names[] = { "DEBUG", "INFO", "WARN", "ERROR", "OFF" };
+
+std::atomic<int> logger::s_level(logger::LEVEL_INFO);
+thread_local logger::ring* logger::t_ring = nullptr;
+
+logger* logger::instance()
+{
+    static logger log;
+    return &log;
+}
+
+logger::logger() : m_fd(STDERR_FILENO), m_thread(0), m_running(false), m_out_len(0), m_stamp_sec(-1)
+{
+    m_stamp[0] = '\0';
+}
+
+logger::~logger()
+{
+    stop();
+    for (size_t i = 0; i < m_rings.size(); ++i)
+    {
+        delete [] m_rings[i]->buf;
+        delete m_rings[i];
+    }
+}
+
+bool logger::init(const char* path)
+{
+    if (path != nullptr)
+    {
+        int fd = open(path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+        if (fd < 0)
+        {
+            return false;
+        }
+        m_fd = fd;
+    }
+    m_running.store(true, std::memory_order_release);
+    if (pthread_create(&m_thread, NULL, worker, this) != 0)
+    {
+        m_running.store(false, std::memory_order_release);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * 在退出前调用，之后写的日志直接输出
+*/
+void logger::stop()
+{
+    if (!m_running.exchange(false))
+    {
+        return;
+    }
+    pthread_join(m_thread, NULL);
+    drain();
+    flush();
+}
+
+bool logger::parse_level(const char* name, LEVEL* level)
+{
+    for (int i = LEVEL_DEBUG; i <= LEVEL_OFF; ++i)
+    {
+        if (strcasecmp(name, level_names[i]) == 0)
+        {
+            *level = (LEVEL)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+uint64_t logger::dropped()
+{
+    uint64_t sum = 0;
+    m_lock.lock();
+    for (size_t i = 0; i < m_rings.size(); ++i)
+    {
+        sum += m_rings[i]->dropped.load(std::memory_order_relaxed);
+    }
+    m_lock.unlock();
+    return sum;
+}
+
+void logger::encode(slot& s, char* base, size_t& offset, const char* value)
+{
+    const char* src = value ? value : "(null)";
+    size_t len = strnlen(src, MAX_STRING);
+    memcpy(base + offset, src, len);
+    base[offset + len] = '\0';
+    s.u = offset;
+    offset += len + 1;
+}
+
+logger::ring* logger::add_ring()
+{
+    ring* r = new ring;
+    r->buf = new char[RING_SIZE];
+    r->tid = syscall(SYS_gettid);
+    r->dropped.store(0, std::memory_order_relaxed);
+    r->reported = 0;
+    r->head.store(0, std::memory_order_relaxed);
+    r->tail.store(0, std::memory_order_relaxed);
+    m_lock.lock();
+    m_rings.push_back(r);
+    m_lock.unlock();
+    t_ring = r;
+    return r;
+}
+
+/**
+ * 记录不跨越缓冲区末尾，末尾剩余空间不够时写入一条填充记录后从头开始
+*/
+char* logger::reserve(ring* r, size_t size)
+{
+    uint64_t tail = r->tail.load(std::memory_order_relaxed);
+    uint64_t head = r->head.load(std::memory_order_acquire);
+    size_t offset = tail & (RING_SIZE - 1);
+    size_t contiguous = RING_SIZE - offset;
+    size_t need = (contiguous < size) ? contiguous + size : size;
+    if (tail + need - head > (uint64_t)RING_SIZE)
+    {
+        return nullptr;
+    }
+    if (contiguous < size)
+    {
+        record* pad = (record*)(r->buf + offset);
+        pad->size = contiguous;     // 剩余空间可能小于记录头部，只写前8个字节
+        pad->level = PADDING;
+        commit(r, contiguous);
+        offset = 0;
+    }
+    return r->buf + offset;
+}
+
+void* logger::worker(void* arg)
+{
+    ((logger*)arg)->run();
+    return nullptr;
+}
+
+/**
+ * 写日志时不通知后台线程，没有日志时后台线程休眠一段时间再轮询
+*/
+void logger::run()
+{
+    struct timespec interval = { 0, 10 * 1000 * 1000 };
+    while (m_running.load(std::memory_order_acquire))
+    {
+        if (!drain())
+        {
+            flush();
+            nanosleep(&interval, nullptr);
+        }
+    }
+}
+
+bool logger::drain()
+{
+    bool got = false;
+    m_lock.lock();
+    for (size_t i = 0; i < m_rings.size(); ++i)
+    {
+        ring* r = m_rings[i];
+        uint64_t head = r->head.load(std::memory_order_relaxed);
+        uint64_t tail = r->tail.load(std::memory_order_acquire);
+        while (head < tail)
+        {
+            const record* rec = (const record*)(r->buf + (head & (RING_SIZE - 1)));
+            if (rec->level != PADDING)
+            {
+                append(rec, r->tid);
+            }
+            head += rec->size;
+        }
+        if (head != r->head.load(std::memory_order_relaxed))
+        {
+            r->head.store(head, std::memory_order_release);
+            got = true;
+        }
+
+        uint64_t dropped = r->dropped.load(std::memory_order_relaxed);
+        if (dropped != r->reported)
+        {
+            if (m_out_len + MAX_LINE > (int)sizeof(m_out))
+            {
+                flush();
+            }
+            struct timespec now;
+            clock_gettime(CLOCK_REALTIME_COARSE, &now);
+            m_out_len += snprintf(m_out + m_out_len, MAX_LINE, "%s.%03ld WARN [%d] dropped %llu log records\n",
+                                  stamp(now.tv_sec), now.tv_nsec / 1000000, (int)r->tid, (unsigned long long)(dropped - r->reported));
+            r->reported = dropped;
+        }
+    }
+    m_lock.unlock();
+    return got;
+}
+
+/**
+ * 同一秒内的记录复用格式化好的日期和时间
+*/
+const char* logger::stamp(time_t sec)
+{
+    if (sec != m_stamp_sec)
+    {
+        struct tm tm;
+        localtime_r(&sec, &tm);
+        strftime(m_stamp, sizeof(m_stamp), "%Y-%m-%d %H:%M:%S", &tm);
+        m_stamp_sec = sec;
+    }
+    return m_stamp;
+}
+
+/**
+ * 格式化一条记录到输出缓冲区
+*/
+void logger::append(const record* rec, pid_t tid)
+{
+    if (m_out_len + MAX_LINE > (int)sizeof(m_out))
+    {
+        flush();
+    }
+    char* line = m_out + m_out_len;
+    int len = snprintf(line, MAX_LINE, "%s.%03ld %s [%d] ", stamp(rec->time.tv_sec), rec->time.tv_nsec / 1000000,
+                       level_names[rec->level], (int)tid);
+    int n = rec->func(line + len, MAX_LINE - len - 1, rec->format, (const slot*)(rec + 1), (const char*)rec);
+    if (n > 0)
+    {
+        len += (n < MAX_LINE - len - 1) ? n : MAX_LINE - len - 2;
+    }
+    if (line[len - 1] != '\n')
+    {
+        line[len++] = '\n';
+    }
+    m_out_len += len;
+}
+
+void logger::flush()
+{
+    int sent = 0;
+    while (sent < m_out_len)
+    {
+        ssize_t n = ::write(m_fd, m_out + sent, m_out_len - sent);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            break;  // 日志写失败时丢弃
+        }
+        sent += n;
+    }
+    m_out_len = 0;
+}
+
+void logger::write_now(LEVEL level, const char* format, format_func func, const slot* slots, const char* base)
+{
+    struct timespec now;
+    struct tm tm;
+    char date[32];
+    char line[MAX_LINE];
+    clock_gettime(CLOCK_REALTIME_COARSE, &now);
+    localtime_r(&now.tv_sec, &tm);
+    strftime(date, sizeof(date), "%Y-%m-%d %H:%M:%S", &tm);
+    int len = snprintf(line, sizeof(line), "%s.%03ld %s [%d] ", date, now.tv_nsec / 1000000,
+                       level_names[level], (int)syscall(SYS_gettid));
+    int n = func(line + len, sizeof(line) - len - 1, format, slots, base);
+    if (n > 0)
+    {
+        len += (n < (int)sizeof(line) - len - 1) ? n : (int)sizeof(line) - len - 2;
+    }
+    if (line[len - 1] != '\n')
+    {
+        line[len++] = '\n';
+    }
+    ssize_t ret = ::write(instance()->m_fd, line, len);
+    (void)ret;
+}
@@ -0,0 +1,207 @@
+#ifndef LOGGER_H
+#define LOGGER_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/types.h>
+#include <time.h>
+#include <atomic>
+#include <vector>
+#include <type_traits>
+#include <pthread.h>
+
+#include "locker.h"
+
+/**
+ * 异步分级日志
+ * 每个线程第一次写日志时注册自己的单生产者单消费者环形缓冲区，写日志只把格式串指针、时间和参数的二进制值
+ * 复制到本线程的缓冲区，不格式化、不加锁、不进行系统调用；后台线程轮询所有缓冲区，格式化后批量写入文件。
+ * 低于当前级别的日志只有一次relaxed读。格式串必须是字符串常量，字符串参数在写日志时复制（最多MAX_STRING字节）。
+ * 缓冲区满时丢弃日志并计数，不阻塞调用者；同一线程的日志按顺序输出，不同线程之间不保证顺序
+*/
+class logger
+{
+public:
+    enum LEVEL { LEVEL_DEBUG = 0, LEVEL_INFO, LEVEL_WARN, LEVEL_ERROR, LEVEL_OFF };
+    static const int RING_SIZE = 64 * 1024;     // 每个线程的缓冲区大小，2的幂
+    static const int MAX_STRING = 256;          // 字符串参数最多复制的字节数
+    static const int MAX_ARGS = 16;             // 每条日志最多的参数个数
+    static const int MAX_LINE = 1024;           // 格式化后一行的最大长度
+
+public:
+    static logger* instance();
+    bool init(const char* path);    // 打开日志文件（nullptr为标准错误）并启动后台线程
+    void stop();    // 输出所有缓冲的日志后结束后台线程
+    static bool enabled(LEVEL level) { return level >= s_level.load(std::memory_order_relaxed); }
+    static void set_level(LEVEL level) { s_level.store(level, std::memory_order_relaxed); }
+    static LEVEL level() { return (LEVEL)s_level.load(std::memory_order_relaxed); }
+    static bool parse_level(const char* name, LEVEL* level);    // debug/info/warn/error/off
+    uint64_t dropped();     // 因缓冲区满丢弃的日志数
+
+    template<typename... Args>
+    static void log(LEVEL level, const char* format, Args... args);
+
+private:
+    logger();
+    ~logger();
+    logger(const logger&);
+    logger& operator=(const logger&);
+
+    // 每个参数占一个8字节槽，字符串参数的槽中保存字符串在记录中的偏移
+    union slot
+    {
+        uint64_t u;
+        double d;
+    };
+    typedef int (*format_func)(char* buf, int size, const char* format, const slot* slots, const char* base);
+
+    static const uint32_t PADDING = 0xffffffff;
+    // 记录头部，其后是参数槽和复制的字符串，总长度按8字节对齐
+    struct record
+    {
+        uint32_t size;      // 整条记录的长度
+        uint32_t level;     // 为PADDING时是缓冲区末尾的填充
+        format_func func;
+        const char* format;
+        struct timespec time;
+    };
+
+    struct ring
+    {
+        char* buf;
+        pid_t tid;
+        std::atomic<uint64_t> dropped;  // 所属线程写入
+        uint64_t reported;  // 后台线程已报告的丢弃数
+        char pad0[64];
+        std::atomic<uint64_t> head;     // 后台线程读取的位置
+        char pad1[64];
+        std::atomic<uint64_t> tail;     // 所属线程写入的位置
+    };
+
+    // 参数的编码和解码
+    static size_t string_size(const char* s) { return strnlen(s ? s : "(null)", MAX_STRING) + 1; }
+    template<typename T> static size_t extra_size(const T&) { return 0; }
+    static size_t extra_size(const char* s) { return string_size(s); }
+    static size_t extra_size(char* s) { return string_size(s); }
+    template<typename T> static void encode(slot& s, char* base, size_t& offset, const T& value)
+    {
+        static_assert(std::is_arithmetic<T>::value || std::is_pointer<T>::value || std::is_enum<T>::value,
+                      "log arguments must be numbers, pointers or strings");
+        static_assert(sizeof(T) <= sizeof(slot), "log argument too large");
+        s.u = 0;
+        memcpy(&s, &value, sizeof(T));
+    }
+    static void encode(slot& s, char* base, size_t& offset, const char* value);
+    static void encode(slot& s, char* base, size_t& offset, char* value) { encode(s, base, offset, (const char*)value); }
+    template<typename T> static T decode(const slot& s, const char* base)
+    {
+        T value;
+        memcpy(&value, &s, sizeof(T));
+        return value;
+    }
+
+    template<int... I> struct indices {};
+    template<int N, int... I> struct make_indices : make_indices<N - 1, N - 1, I...> {};
+    template<int... I> struct make_indices<0, I...> { typedef indices<I...> type; };
+
+    template<typename... Args, int... I>
+    static int format_args(char* buf, int size, const char* format, const slot* slots, const char* base, indices<I...>)
+    {
+        return snprintf(buf, size, format, decode<Args>(slots[I], base)...);
+    }
+    template<typename... Args>
+    static int format_record(char* buf, int size, const char* format, const slot* slots, const char* base)
+    {
+        return format_args<Args...>(buf, size, format, slots, base, typename make_indices<sizeof...(Args)>::type());
+    }
+
+    char* reserve(ring* r, size_t size);    // 在缓冲区中预留一条记录的空间，已满返回nullptr
+    static void commit(ring* r, size_t size) { r->tail.store(r->tail.load(std::memory_order_relaxed) + size, std::memory_order_release); }
+    static void write_now(LEVEL level, const char* format, format_func func, const slot* slots, const char* base);
+    ring* add_ring();   // 为当前线程注册缓冲区
+    static void* worker(void* arg);
+    void run();
+    bool drain();   // 输出所有缓冲区中的日志，没有日志时返回false
+    void append(const record* rec, pid_t tid);
+    const char* stamp(time_t sec);  // 格式化到秒的时间
+    void flush();
+
+private:
+    static std::atomic<int> s_level;
+    static thread_local ring* t_ring;
+    locker m_lock;      // 保护m_rings
+    std::vector<ring*> m_rings;
+    int m_fd;
+    pthread_t m_thread;
+    std::atomic<bool> m_running;
+    char m_out[64 * 1024];  // 后台线程的输出缓冲区
+    int m_out_len;
+    time_t m_stamp_sec;     // m_stamp对应的秒数，同一秒内的日志复用格式化好的时间
+    char m_stamp[32];
+};
+
+template<> inline const char* logger::decode<const char*>(const slot& s, const char* base) { return base + s.u; }
+template<> inline char* logger::decode<char*>(const slot& s, const char* base) { return (char*)base + s.u; }
+
+template<typename... Args>
+void logger::log(LEVEL level, const char* format, Args... args)
+{
+    static_assert(sizeof...(Args) <= MAX_ARGS, "too many log arguments");
+    size_t extra[] = { 0, extra_size(args)... };
+    size_t size = sizeof(record) + sizeof(slot) * sizeof...(Args);
+    for (size_t i = 1; i < sizeof(extra) / sizeof(extra[0]); ++i)
+    {
+        size += extra[i];
+    }
+    size = (size + 7) & ~(size_t)7;
+
+    logger* self = instance();
+    if (!self->m_running.load(std::memory_order_relaxed))
+    {
+        // 后台线程未启动（如基准测试程序）时直接格式化输出
+        char buf[sizeof(slot) * (MAX_ARGS + 1) + (MAX_ARGS + 1) * (MAX_STRING + 1)];
+        slot* slots = (slot*)buf;
+        size_t offset = sizeof(slot) * (sizeof...(Args) + 1);
+        int i = 0;
+        int expand[] = { 0, (encode(slots[i++], buf, offset, args), 0)... };
+        (void)expand;
+        write_now(level, format, format_record<Args...>, slots, buf);
+        return;
+    }
+    ring* r = t_ring ? t_ring : self->add_ring();
+    char* p = self->reserve(r, size);
+    if (p == nullptr)   // 缓冲区满，丢弃
+    {
+        r->dropped.store(r->dropped.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        return;
+    }
+
+    record* rec = (record*)p;
+    rec->size = size;
+    rec->level = level;
+    rec->func = format_record<Args...>;
+    rec->format = format;
+    clock_gettime(CLOCK_REALTIME_COARSE, &rec->time);
+    slot* slots = (slot*)(rec + 1);
+    size_t offset = sizeof(record) + sizeof(slot) * sizeof...(Args);
+    int i = 0;
+    int expand[] = { 0, (encode(slots[i++], p, offset, args), 0)... };
+    (void)expand;
+    commit(r, size);
+}
+
+#define LOG_AT(level, ...) \
+    do \
+    { \
+        if (logger::enabled(level)) \
+        { \
+            logger::log(level, __VA_ARGS__); \
+        } \
+    } while (0)
+#define LOG_DEBUG(...) LOG_AT(logger::LEVEL_DEBUG, __VA_ARGS__)
+#define LOG_INFO(...) LOG_AT(logger::LEVEL_INFO, __VA_ARGS__)
+#define LOG_WARN(...) LOG_AT(logger::LEVEL_WARN, __VA_ARGS__)
+#define LOG_ERROR(...) LOG_AT(logger::LEVEL_ERROR, __VA_ARGS__)
+
+#endif
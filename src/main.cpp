@@ -1,5 +1,6 @@
 #include <sys/socket.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <arpa/inet.h>
 #include <stdio.h>
 #include <unistd.h>
@@ -11,23 +12,56 @@
 #include <event.h>
 #include <thread.h>
 #include <pthread.h>
+#include <getopt.h>
+#include <stdint.h>
 
 #include "locker.h"
 #include "threadpool.h"
+#include "ws_threadpool.h"
 #include "http_conn.h"
-
-#define MAX_FD 65536
+#include "file_cache.h"
+#include "http_response.h"
+#include "timer_wheel.h"
+#include "conn_table.h"
+#include "latency_stats.h"
+#include "server_metrics.h"
+#include "logger.h"
 
 // 全局变量
 threadpool< http_conn >* pool = nullptr;    // 线程池对象
-http_conn* users = nullptr;     // 任务类集合
+ws_threadpool< http_conn >* ws_pool = nullptr;  // 工作窃取线程池对象，与pool二选一
+
+/**
+ * 多reactor模式下的事件循环线程，每个线程拥有独立的event_base和SO_REUSEPORT监听socket，
+ * 连接的读、解析、写全部在所属线程内完成
+*/
+struct reactor
+{
+    pthread_t tid;
+    struct event_base* base;
+    int listenfd;
+    timer_wheel* wheel;     // 该事件循环上所有连接的超时定时器
+};
+int reactor_number = 0;     // reactor线程数，为0时使用单事件循环+线程池模式
+reactor* reactors = nullptr;
+int listen_backlog = 1024;  // 监听队列长度
+int fastopen_qlen = 0;      // TCP_FASTOPEN队列长度，为0时不启用
+logger::LEVEL log_level = logger::LEVEL_INFO;   // 启动时设置的日志级别
+
+/**
+ * 线程池中等待处理的任务数，多reactor模式下没有线程池
+*/
+size_t pool_queue_depth()
+{
+    return pool ? pool->queue_size() : ws_pool ? ws_pool->queue_size() : 0;
+}
 
 /**
  * 向客户端发送错误信息
 */
 void show_error(int connfd, const char* info)
 {
-    printf("%s", info);
+    LOG_WARN("%s", info);
     send(connfd, info, strlen(info), 0);
 }
 
@@ -36,13 +70,38 @@ void show_error(int connfd, const char* info)
 */
 void httprequest_cb(int fd, short events, void* arg)
 {
-    if (users[fd].read())   // 读取到数据，进行HTTP请求分析
+    // 事件参数是连接句柄，连接已关闭时句柄失效
+    http_conn* conn = conn_table::instance()->get((uint64_t)(uintptr_t)arg);
+    // 连接正在处理或发送时，本次可读事件由持有连接的一方合并处理
+    if (!conn || !conn->try_queue())
+    {
+        return;
+    }
+    if (conn->read())   // 读取到数据，进行HTTP请求分析
     {
-        pool->append(users + fd);
+        conn->pause_timer();
+        if ((pool || ws_pool) && http_conn::m_inline && conn->process_inline())    // 命中文件缓存，已在当前线程处理完毕
+        {
+            return;
+        }
+        conn->add_ref();    // 任务持有的引用，process()结束时释放
+        if (pool || ws_pool)
+        {
+            conn->mark_queued();
+            if (!(pool ? pool->append(conn) : ws_pool->append(conn)))   // 请求队列已满
+            {
+                conn->release();
+                conn->close_conn();
+            }
+        }
+        else    // 多reactor模式，在当前线程直接处理
+        {
+            conn->process();
+        }
     }
     else        // 读取失败，关闭连接，释放资源
     {
-        users[fd].close_conn();
+        conn->close_conn();
     }
 }
 
@@ -51,117 +110,321 @@ void httprequest_cb(int fd, short events, void* arg)
 */
 void abletowrite_cb(int fd, short events, void* arg)
 {
-    if (!users[fd].write())     // 写HTTP响应
+    http_conn* conn = conn_table::instance()->get((uint64_t)(uintptr_t)arg);
+    if (conn && !conn->write())     // 写HTTP响应
     {
         // 写失败，关闭连接，释放资源
-        users[fd].close_conn();
+        conn->close_conn();
     }
 }
 
+/**
+ * 连接超时回调函数，由时间轮在事件循环线程中调用
+*/
+bool timeout_cb(void* arg)
+{
+    return ((http_conn*)arg)->timeout();
+}
+
+/**
+ * 连接的定时器节点移出时间轮，释放节点持有的引用
+*/
+void timer_detach_cb(void* arg)
+{
+    ((http_conn*)arg)->release();
+}
+
 /**
  * 新连接到来处理函数
 */
 void accept_cb(int listenfd, short events, void* arg)
 {
-    evutil_socket_t sockfd;
-    struct sockaddr_in client;
-    socklen_t len = sizeof(client);
- 
-    // 接受客户连接
-    sockfd = accept(listenfd, (struct sockaddr*)&client, &len);
-    if (sockfd < 0)
-    {
-        printf("errno is: %d\n", errno);
-        return;
-    }
-    if (http_conn::m_user_count >= MAX_FD )
+    reactor* r = (reactor*)arg;
+    struct event_base* base = r->base;
+    // 边沿触发只通知一次，循环接受直到监听队列为空，否则剩余的连接要等到下一个连接到来才会被处理
+    while (true)
     {
-        show_error(sockfd, "Internal server busy");
-        close(sockfd);
-        return;
+        struct sockaddr_in client;
+        socklen_t len = sizeof(client);
+        // 新socket直接设置为非阻塞，省去每个连接两次fcntl
+        evutil_socket_t sockfd = accept4(listenfd, (struct sockaddr*)&client, &len, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (sockfd < 0)
+        {
+            if (errno == EINTR || errno == ECONNABORTED)    // 被信号中断或对方已放弃连接
+            {
+                continue;
+            }
+            if (errno != EAGAIN && errno != EWOULDBLOCK)
+            {
+                LOG_ERROR("accept4 failed, errno is: %d", errno);
+            }
+            return;
+        }
+        http_conn* conn = conn_table::instance()->open();
+        if (!conn)  // 连接数已达上限
+        {
+            show_error(sockfd, "Internal server busy");
+            close(sockfd);
+            continue;
+        }
+
+        // 初始化http_conn，读写事件处理器内嵌在连接中，接受连接不分配内存
+        conn->init(sockfd, client, base, httprequest_cb, abletowrite_cb, r->wheel);
+        server_metrics::add(server_metrics::CONN_ACCEPTED);
     }
- 
-    // 为新客户连接创建读写事件处理器
-    struct event_base* base = (event_base*)arg;
-    struct event *read_ev = event_new(NULL, -1, 0, NULL, NULL);
-    event_assign(read_ev, base, sockfd, EV_READ | EV_ET | EV_PERSIST,
-                 httprequest_cb, (void*)read_ev);
-    struct event *write_ev = event_new(NULL, -1, 0, NULL, NULL);
-    event_assign(write_ev, base, sockfd, EV_WRITE | EV_ET | EV_PERSIST,
-                 abletowrite_cb, (void*)write_ev);
-    
-    // 初始化http_conn
-    users[sockfd].init(sockfd, client, read_ev, write_ev);
-    
 }
 
-int main(int argc, char* argv[])
+/**
+ * 创建监听socket
+ * reuseport：是否设置SO_REUSEPORT，多reactor模式下每个线程绑定同一端口，由内核分发连接
+*/
+int create_listenfd(const char* ip, int port, bool reuseport)
 {
-    if( argc <= 2 )
+    // accept_cb()循环接受连接直到EAGAIN，监听socket必须是非阻塞的
+    int listenfd = socket(PF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    assert(listenfd >= 0);
+    // 设置断开连接方式为RST
+    struct linger tmp = { 1, 0 };
+    setsockopt(listenfd, SOL_SOCKET, SO_LINGER, &tmp, sizeof(tmp));
+    // 正常关闭的连接会留下TIME_WAIT，允许重启时立即重新绑定端口
+    int reuse = 1;
+    setsockopt(listenfd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    if (reuseport)
     {
-        printf("usage: %s ip_address port_number\n", basename(argv[0]));
-        return 1;
+        int on = 1;
+        if (setsockopt(listenfd, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on)) < 0)
+        {
+            LOG_ERROR("setsockopt SO_REUSEPORT failed, errno is: %d", errno);
+            close(listenfd);
+            return -1;
+        }
     }
-    const char* ip = argv[1];
-    int port = atoi(argv[2]);
 
-    // 启动libevent多线程机制
-    evthread_use_pthreads();
+    int ret = 0;
+    struct sockaddr_in address;
+    bzero(&address, sizeof( address ));
+    address.sin_family = AF_INET;
+    inet_pton(AF_INET, ip, &address.sin_addr);
+    address.sin_port = htons(port);
+
+    ret = bind(listenfd, (struct sockaddr*)&address, sizeof(address));
+    assert( ret >= 0 );
 
-    try
+    // 收到请求数据后才完成accept，只建立连接不发送数据的客户端不占用http_conn，
+    // 超过头部超时时间仍没有数据时内核照常交付连接，由头部超时关闭
+    if (http_conn::m_header_timeout > 0)
     {
-        pool = new threadpool< http_conn >;
+        int defer = http_conn::m_header_timeout;
+        setsockopt(listenfd, IPPROTO_TCP, TCP_DEFER_ACCEPT, &defer, sizeof(defer));
     }
-    catch( ... )
+    // 允许客户端在SYN中携带请求数据，省去一个往返
+    if (fastopen_qlen > 0 && setsockopt(listenfd, IPPROTO_TCP, TCP_FASTOPEN, &fastopen_qlen, sizeof(fastopen_qlen)) < 0)
     {
+        LOG_WARN("setsockopt TCP_FASTOPEN failed, errno is: %d", errno);
+    }
+
+    ret = listen(listenfd, listen_backlog);
+    assert(ret >= 0);
+    return listenfd;
+}
+
+/**
+ * SIGUSR1信号回调函数，在启动时设置的日志级别和DEBUG之间切换
+*/
+void toggle_debug_cb(int sig, short events, void* arg)
+{
+    logger::set_level(logger::level() == logger::LEVEL_DEBUG ? log_level : logger::LEVEL_DEBUG);
+}
+
+/**
+ * reactor线程的工作函数
+*/
+void* reactor_worker(void* arg)
+{
+    reactor* r = (reactor*)arg;
+    r->wheel->bind_thread();
+    event_base_dispatch(r->base);
+    return r;
+}
+
+int main(int argc, char* argv[])
+{
+    int opt;
+    bool work_stealing = false;
+    int cache_size = 256;   // 文件缓存容量，单位MB
+    int max_connections = 65536;
+    bool level_ok = true;
+    const char* log_file = nullptr;     // 为nullptr时日志写到标准错误
+    while ((opt = getopt(argc, argv, "r:wc:zm:t:n:ib:f:d:l:o:")) != -1)
+    {
+        switch (opt)
+        {
+            case 'r':
+                reactor_number = atoi(optarg);
+                break;
+            case 'w':
+                work_stealing = true;
+                break;
+            case 'c':
+                cache_size = atoi(optarg);
+                break;
+            case 'z':
+                http_conn::m_use_sendfile = true;
+                break;
+            case 'm':
+                http_conn::m_read_buffer_limit = atoi(optarg) * 1024;
+                break;
+            case 't':
+                if (sscanf(optarg, "%d,%d,%d,%d", &http_conn::m_header_timeout, &http_conn::m_body_timeout,
+                           &http_conn::m_keepalive_timeout, &http_conn::m_write_timeout) != 4)
+                {
+                    http_conn::m_header_timeout = -1;
+                }
+                break;
+            case 'n':
+                max_connections = atoi(optarg);
+                break;
+            case 'i':
+                http_conn::m_inline = true;
+                break;
+            case 'b':
+                listen_backlog = atoi(optarg);
+                break;
+            case 'f':
+                fastopen_qlen = atoi(optarg);
+                break;
+            case 'd':
+                http_conn::m_doc_root = optarg;
+                break;
+            case 'l':
+                level_ok = logger::parse_level(optarg, &log_level);
+                break;
+            case 'o':
+                log_file = optarg;
+                break;
+            default:
+                break;
+        }
+    }
+    if( argc - optind < 2 || reactor_number < 0 || cache_size < 0 || max_connections <= 0
+        || listen_backlog <= 0 || fastopen_qlen < 0 || !level_ok
+        || strlen(http_conn::m_doc_root) > http_conn::FILENAME_LEN / 2
+        || http_conn::m_read_buffer_limit < http_conn::READ_BUFFER_SIZE
+        || http_conn::m_header_timeout < 0 || http_conn::m_body_timeout < 0
+        || http_conn::m_keepalive_timeout < 0 || http_conn::m_write_timeout < 0 )
+    {
+        printf("usage: %s [-r reactor_number] [-w] [-c cache_size_mb] [-z] [-m max_header_kb] "
+               "[-t header,body,keepalive,write] [-n max_connections] [-i] "
+               "[-b backlog] [-f fastopen_qlen] [-d doc_root] [-l debug|info|warn|error|off] [-o log_file] "
+               "ip_address port_number\n", basename(argv[0]));
+        return 1;
+    }
+    // 日志由后台线程格式化输出，退出时输出剩余的日志
+    logger::set_level(log_level);
+    if (!logger::instance()->init(log_file))
+    {
+        printf("cannot open log file %s\n", log_file);
         return 1;
     }
+    const char* ip = argv[optind];
+    int port = atoi(argv[optind + 1]);
+
+    if (reactor_number == 0)
+    {
+        // 启动libevent多线程机制
+        evthread_use_pthreads();
+
+        try
+        {
+            if (work_stealing)
+            {
+                ws_pool = new ws_threadpool< http_conn >;
+            }
+            else
+            {
+                pool = new threadpool< http_conn >;
+            }
+        }
+        catch( ... )
+        {
+            return 1;
+        }
+    }
 
-    // 预先为每一个可能的客户连接分配一个http_conn对象
-    users = new http_conn[MAX_FD];
-    assert(users);
+    // 连接对象随并发连接数增长按块分配
+    conn_table::instance()->init(max_connections);
 
 
     /**** 创建服务器 ****/
 
-    struct event_base* base = event_base_new();
-    assert(base != nullptr);
-    http_conn::base = base;
-    evthread_make_base_notifiable(base);
+    int count = (reactor_number == 0) ? 1 : reactor_number;
+    reactors = new reactor[count];
+    for (int i = 0; i < count; ++i)
+    {
+        reactors[i].base = event_base_new();
+        assert(reactors[i].base != nullptr);
+        if (reactor_number == 0)
+        {
+            // 工作线程会跨线程注册事件
+            evthread_make_base_notifiable(reactors[i].base);
+        }
+        reactors[i].listenfd = create_listenfd(ip, port, reactor_number > 0);
+        if (reactors[i].listenfd < 0)
+        {
+            return 1;
+        }
 
-    int listenfd = socket(PF_INET, SOCK_STREAM, 0);
-    assert(listenfd >= 0);
-    // 设置断开连接方式为RST
-    struct linger tmp = { 1, 0 };
-    setsockopt(listenfd, SOL_SOCKET, SO_LINGER, &tmp, sizeof(tmp));
+        reactors[i].wheel = new timer_wheel(reactors[i].base, timeout_cb, timer_detach_cb);
 
-    int ret = 0;
-    struct sockaddr_in address;
-    bzero(&address, sizeof( address ));
-    address.sin_family = AF_INET;
-    inet_pton(AF_INET, ip, &address.sin_addr);
-    address.sin_port = htons(port);
+        // 为listenfd注册永久读事件
+        struct event* ev_listen = event_new(reactors[i].base, reactors[i].listenfd,
+                                            EV_READ | EV_ET | EV_PERSIST, accept_cb, reactors + i);
+        event_add(ev_listen, NULL);
+    }
+    http_conn::base = reactors[0].base;
 
-    ret = bind(listenfd, (struct sockaddr*)&address, sizeof(address));
-    assert( ret >= 0 );
+    // 文件缓存，容量为0时不缓存；sendfile模式下不需要映射文件
+    file_cache::instance()->init(10000, (size_t)cache_size << 20, !http_conn::m_use_sendfile);
+    if (cache_size > 0)
+    {
+        file_cache::instance()->attach(reactors[0].base);
+    }
 
-    ret = listen(listenfd, 5);
-    assert(ret >= 0);
+    // 定时合并各线程的请求延迟直方图
+    latency_stats::instance()->attach(reactors[0].base);
+    // 每秒开始时刷新响应的Date行
+    http_response::instance()->attach(reactors[0].base);
+    server_metrics::instance()->set_queue_depth(pool_queue_depth);
 
     // 忽略SIGPIPE信号
-    struct event* ev_sigpipe = event_new(base, SIGPIPE, EV_SIGNAL | EV_PERSIST, nullptr, nullptr);
+    struct event* ev_sigpipe = event_new(reactors[0].base, SIGPIPE, EV_SIGNAL | EV_PERSIST, nullptr, nullptr);
     event_add(ev_sigpipe, NULL);
+    struct event* ev_sigusr1 = event_new(reactors[0].base, SIGUSR1, EV_SIGNAL | EV_PERSIST, toggle_debug_cb, nullptr);
+    event_add(ev_sigusr1, NULL);
 
-    // 为listenfd注册永久读事件
-    struct event* ev_listen = event_new(base, listenfd, EV_READ | EV_ET | EV_PERSIST, accept_cb, base);
-    event_add(ev_listen, NULL);
-
-    // 开始事件循环
-    event_base_dispatch(base);
+    // 开始事件循环，reactor 0运行在主线程
+    for (int i = 1; i < count; ++i)
+    {
+        if (pthread_create(&reactors[i].tid, NULL, reactor_worker, reactors + i) != 0)
+        {
+            return 1;
+        }
+    }
+    reactors[0].wheel->bind_thread();
+    event_base_dispatch(reactors[0].base);
+    for (int i = 1; i < count; ++i)
+    {
+        pthread_join(reactors[i].tid, NULL);
+    }
 
-    close(listenfd);
-    delete [] users;
+    for (int i = 0; i < count; ++i)
+    {
+        close(reactors[i].listenfd);
+        delete reactors[i].wheel;
+    }
+    delete [] reactors;
     delete pool;
+    delete ws_pool;
     return 0;
 }
 
@@ -0,0 +1,145 @@
+#ifndef MPMC_QUEUE_H
+#define MPMC_QUEUE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+
+/**
+ * 有界无锁多生产者多消费者队列（环形缓冲区）
+ * 每个槽位带有序号，生产者和消费者各自通过CAS推进入队/出队位置，
+ * 入队和出队均不分配内存，也不进行系统调用。容量向上取整为2的幂
+*/
+template<typename T>
+class mpmc_queue
+{
+public:
+    explicit mpmc_queue(size_t capacity);
+    ~mpmc_queue();
+    bool push(const T& data);   // 入队，队列已满返回false
+    bool pop(T& data);          // 出队，队列为空返回false
+    size_t size() const;        // 队列中元素个数的近似值
+    size_t capacity() const { return m_mask + 1; }
+
+private:
+    mpmc_queue(const mpmc_queue&);
+    mpmc_queue& operator=(const mpmc_queue&);
+
+    static const size_t CACHELINE_SIZE = 64;
+    struct cell
+    {
+        std::atomic<size_t> sequence;   // 槽位序号，用于判断槽位可写还是可读
+        T data;
+    };
+
+private:
+    char m_pad0[CACHELINE_SIZE];
+    cell* m_buffer;
+    size_t m_mask;
+    char m_pad1[CACHELINE_SIZE];
+    std::atomic<size_t> m_enqueue_pos;  // 生产者位置，单独占一个cache line
+    char m_pad2[CACHELINE_SIZE];
+    std::atomic<size_t> m_dequeue_pos;  // 消费者位置，单独占一个cache line
+    char m_pad3[CACHELINE_SIZE];
+};
+
+template<typename T>
+mpmc_queue<T>::mpmc_queue(size_t capacity) : m_buffer(nullptr), m_mask(0)
+{
+    if (capacity < 2)
+    {
+        capacity = 2;
+    }
+    size_t size = 1;
+    while (size < capacity)
+    {
+        size <<= 1;
+    }
+    m_buffer = new cell[size];
+    m_mask = size - 1;
+    for (size_t i = 0; i < size; ++i)
+    {
+        m_buffer[i].sequence.store(i, std::memory_order_relaxed);
+    }
+    m_enqueue_pos.store(0, std::memory_order_relaxed);
+    m_dequeue_pos.store(0, std::memory_order_relaxed);
+}
+
+template<typename T>
+mpmc_queue<T>::~mpmc_queue()
+{
+    delete [] m_buffer;
+}
+
+template<typename T>
+bool mpmc_queue<T>::push(const T& data)
+{
+    cell* c;
+    size_t pos = m_enqueue_pos.load(std::memory_order_relaxed);
+    while (true)
+    {
+        c = &m_buffer[pos & m_mask];
+        size_t seq = c->sequence.load(std::memory_order_acquire);
+        intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+        if (diff == 0)      // 槽位可写，尝试占用
+        {
+            if (m_enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+            {
+                break;
+            }
+        }
+        else if (diff < 0)  // 槽位仍未被消费，队列已满
+        {
+            return false;
+        }
+        else    // 被其他生产者抢先，重新读取位置
+        {
+            pos = m_enqueue_pos.load(std::memory_order_relaxed);
+        }
+    }
+    c->data = data;
+    c->sequence.store(pos + 1, std::memory_order_release);
+    return true;
+}
+
+template<typename T>
+bool mpmc_queue<T>::pop(T& data)
+{
+    cell* c;
+    size_t pos = m_dequeue_pos.load(std::memory_order_relaxed);
+    while (true)
+    {
+        c = &m_buffer[pos & m_mask];
+        size_t seq = c->sequence.load(std::memory_order_acquire);
+        intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+        if (diff == 0)      // 槽位可读，尝试占用
+        {
+            if (m_dequeue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+            {
+                break;
+            }
+        }
+        else if (diff < 0)  // 槽位尚未写入，队列为空
+        {
+            return false;
+        }
+        else
+        {
+            pos = m_dequeue_pos.load(std::memory_order_relaxed);
+        }
+    }
+    data = c->data;
+    c->sequence.store(pos + m_mask + 1, std::memory_order_release);
+    return true;
+}
+
+template<typename T>
+size_t mpmc_queue<T>::size() const
+{
+    size_t tail = m_enqueue_pos.load(std::memory_order_relaxed);
+    size_t head = m_dequeue_pos.load(std::memory_order_relaxed);
+    return tail > head ? tail - head : 0;
+}
+
+#endif
@@ -0,0 +1,124 @@
+#include "server_metrics.h"
+#include "latency_stats.h"
+
+#include <stdio.h>
+
+const char* const server_metrics::METRICS_URL = "/__metrics";
+thread_local server_metrics::shard* server_metrics::t_shard = nullptr;
+
+server_metrics* server_metrics::instance()
+{
+    static server_metrics metrics;
+    return &metrics;
+}
+
+server_metrics::server_metrics() : m_queue_depth(nullptr)
+{
+}
+
+server_metrics::~server_metrics()
+{
+    for (size_t i = 0; i < m_shards.size(); ++i)
+    {
+        delete m_shards[i];
+    }
+}
+
+void server_metrics::add(COUNTER counter, uint64_t n)
+{
+    shard* s = t_shard ? t_shard : instance()->add_shard();
+    std::atomic<uint64_t>& c = s->counters[counter];
+    c.store(c.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+}
+
+server_metrics::shard* server_metrics::add_shard()
+{
+    shard* s = new shard;
+    for (int i = 0; i < COUNTER_COUNT; ++i)
+    {
+        s->counters[i].store(0, std::memory_order_relaxed);
+    }
+    m_lock.lock();
+    m_shards.push_back(s);
+    m_lock.unlock();
+    t_shard = s;
+    return s;
+}
+
+uint64_t server_metrics::total(COUNTER counter)
+{
+    uint64_t sum = 0;
+    m_lock.lock();
+    for (size_t i = 0; i < m_shards.size(); ++i)
+    {
+        sum += m_shards[i]->counters[counter].load(std::memory_order_relaxed);
+    }
+    m_lock.unlock();
+    return sum;
+}
+
+int server_metrics::render(char* buf, int size)
+{
+    uint64_t totals[COUNTER_COUNT];
+    for (int i = 0; i < COUNTER_COUNT; ++i)
+    {
+        totals[i] = total((COUNTER)i);
+    }
+    uint64_t lookups = totals[CACHE_HITS] + totals[CACHE_MISSES];
+    // 各计数器不是在同一时刻读取的，差值可能暂时为负
+    uint64_t active = totals[CONN_ACCEPTED] > totals[CONN_CLOSED] ? totals[CONN_ACCEPTED] - totals[CONN_CLOSED] : 0;
+    int len = snprintf(buf, size,
+        "# HELP http_connections_accepted_total Connections accepted.\n"
+        "# TYPE http_connections_accepted_total counter\n"
+        "http_connections_accepted_total %llu\n"
+        "# HELP http_connections_closed_total Connections closed.\n"
+        "# TYPE http_connections_closed_total counter\n"
+        "http_connections_closed_total %llu\n"
+        "# HELP http_connections_active Connections currently open.\n"
+        "# TYPE http_connections_active gauge\n"
+        "http_connections_active %llu\n"
+        "# HELP http_requests_total Responses sent, by status code.\n"
+        "# TYPE http_requests_total counter\n"
+        "http_requests_total{code=\"200\"} %llu\n"
+        "http_requests_total{code=\"206\"} %llu\n"
+        "http_requests_total{code=\"304\"} %llu\n"
+        "http_requests_total{code=\"400\"} %llu\n"
+        "http_requests_total{code=\"403\"} %llu\n"
+        "http_requests_total{code=\"404\"} %llu\n"
+        "http_requests_total{code=\"416\"} %llu\n"
+        "http_requests_total{code=\"500\"} %llu\n"
+        "# HELP http_received_bytes_total Bytes read from client sockets.\n"
+        "# TYPE http_received_bytes_total counter\n"
+        "http_received_bytes_total %llu\n"
+        "# HELP http_sent_bytes_total Bytes written to client sockets.\n"
+        "# TYPE http_sent_bytes_total counter\n"
+        "http_sent_bytes_total %llu\n"
+        "# HELP http_pool_queue_depth Tasks waiting in the thread pool.\n"
+        "# TYPE http_pool_queue_depth gauge\n"
+        "http_pool_queue_depth %llu\n"
+        "# HELP http_file_cache_hits_total File lookups served from the file cache.\n"
+        "# TYPE http_file_cache_hits_total counter\n"
+        "http_file_cache_hits_total %llu\n"
+        "# HELP http_file_cache_misses_total File lookups that opened the file.\n"
+        "# TYPE http_file_cache_misses_total counter\n"
+        "http_file_cache_misses_total %llu\n"
+        "# HELP http_file_cache_hit_ratio Fraction of file lookups served from the file cache.\n"
+        "# TYPE http_file_cache_hit_ratio gauge\n"
+        "http_file_cache_hit_ratio %.4f\n",
+        (unsigned long long)totals[CONN_ACCEPTED], (unsigned long long)totals[CONN_CLOSED],
+        (unsigned long long)active,
+        (unsigned long long)totals[STATUS_200], (unsigned long long)totals[STATUS_206],
+        (unsigned long long)totals[STATUS_304], (unsigned long long)totals[STATUS_400],
+        (unsigned long long)totals[STATUS_403], (unsigned long long)totals[STATUS_404],
+        (unsigned long long)totals[STATUS_416], (unsigned long long)totals[STATUS_500],
+        (unsigned long long)totals[BYTES_IN], (unsigned long long)totals[BYTES_OUT],
+        (unsigned long long)(m_queue_depth ? m_queue_depth() : 0),
+        (unsigned long long)totals[CACHE_HITS], (unsigned long long)totals[CACHE_MISSES],
+        lookups ? (double)totals[CACHE_HITS] / lookups : 0.0);
+    if (len >= size)
+    {
+        return size - 1;
+    }
+    // 请求阶段延迟
+    return len + latency_stats::instance()->render(buf + len, size - len);
+}
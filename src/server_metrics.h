@@ -0,0 +1,67 @@
+#ifndef SERVER_METRICS_H
+#define SERVER_METRICS_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+#include <vector>
+
+#include "locker.h"
+
+/**
+ * 服务器运行计数器
+ * 每个线程第一次计数时注册自己的一组计数器，之后只写本线程的计数器，没有锁和原子读改写，与hdr_histogram相同；
+ * 读取时对各线程求和。保留URL METRICS_URL以Prometheus文本格式返回计数器和请求阶段延迟
+*/
+class server_metrics
+{
+public:
+    enum COUNTER
+    {
+        CONN_ACCEPTED = 0,  // 接受的连接
+        CONN_CLOSED,        // 关闭的连接
+        BYTES_IN,           // 从socket读入的字节数
+        BYTES_OUT,          // 写入socket的字节数
+        CACHE_HITS,         // 文件缓存命中
+        CACHE_MISSES,       // 文件缓存未命中，需要打开文件
+        STATUS_200,         // 按状态码统计的响应数
+        STATUS_206,
+        STATUS_304,
+        STATUS_400,
+        STATUS_403,
+        STATUS_404,
+        STATUS_416,
+        STATUS_500,
+        COUNTER_COUNT
+    };
+    static const char* const METRICS_URL;
+    typedef size_t (*gauge_func)();
+
+public:
+    static server_metrics* instance();
+    static void add(COUNTER counter, uint64_t n = 1);   // 计数到当前线程的计数器
+    uint64_t total(COUNTER counter);    // 各线程计数之和
+    void set_queue_depth(gauge_func func) { m_queue_depth = func; }     // 设置读取线程池队列长度的函数
+    int render(char* buf, int size);    // 以Prometheus文本格式输出，返回写入的长度
+
+private:
+    server_metrics();
+    ~server_metrics();
+    server_metrics(const server_metrics&);
+    server_metrics& operator=(const server_metrics&);
+
+    struct shard
+    {
+        std::atomic<uint64_t> counters[COUNTER_COUNT];  // 只由所属线程写入，relaxed读加写
+        char pad[64];   // 避免相邻分配的计数器共享cache line
+    };
+    shard* add_shard();     // 为当前线程注册一组计数器
+
+private:
+    static thread_local shard* t_shard;
+    locker m_lock;      // 保护m_shards
+    std::vector<shard*> m_shards;   // 各线程的计数器，线程退出后保留
+    gauge_func m_queue_depth;
+};
+
+#endif
@@ -1,11 +1,13 @@
 #ifndef THREADPOOL_H
 #define THREADPOOL_H
 
-#include <list>
 #include <cstdio>
+#include <atomic>
 #include <exception>
 #include <pthread.h>
 #include "locker.h"
+#include "logger.h"
+#include "mpmc_queue.h"
 
 /**
  * 线程池类
@@ -17,24 +19,26 @@ public:
     threadpool(int thread_number = 8, int max_requests = 10000);
     ~threadpool();
     bool append(T* request);    // 往请求队列中添加任务，由主线程调用
+    size_t queue_size() const { return m_workqueue.size(); }    // 等待处理的任务数的近似值
 
 private:
     static void* worker(void* arg);  // 线程的工作函数需要为静态函数（全局函数）   
     void run();     // 工作线程实际运行的函数
+    void shutdown(int started); // 结束并回收前started个工作线程
 
 private:
     int m_thread_number;    // 线程池中的线程数
     int m_max_requests;     // 请求队列中允许的最大请求数
     pthread_t* m_threads;   // 描述线程池的数组，大小为m_thread_number
-    std::list<T*> m_workqueue;    // 请求队列
-    locker m_queuelocker;   // 保护请求队列的互斥锁
-    sem m_queuestat;    // 用来通知是否有任务需要处理的信号量
-    bool m_stop;    // 是否结束线程
+    mpmc_queue<T*> m_workqueue;    // 请求队列，无锁环形缓冲区
+    eventcount m_queuestat;    // 队列为空时工作线程在此等待
+    std::atomic<bool> m_stop;   // 是否结束线程
 };
 
 template<typename T>
 threadpool<T>::threadpool(int thread_number, int max_requests) : 
-        m_thread_number(thread_number), m_max_requests(max_requests), m_stop(false), m_threads(nullptr)
+        m_thread_number(thread_number), m_max_requests(max_requests), m_threads(nullptr),
+        m_workqueue(max_requests), m_stop(false)
 {
     if(( thread_number <= 0) || (max_requests <= 0))
     {
@@ -50,15 +54,11 @@ threadpool<T>::threadpool(int thread_number, int max_requests) :
     // 创建线程池
     for (int i = 0; i < thread_number; ++i)
     {
-        printf("create the %dth thread\n", i);
+        LOG_DEBUG("create the %dth thread", i);
+        // 工作线程不设置为脱离，析构时等待其退出后再释放线程池
         if(pthread_create(m_threads + i, NULL, worker, this) != 0 )
         {
-            delete [] m_threads;
-            throw std::exception();
-        }
-        if(pthread_detach(m_threads[i]))    // 设置为脱离线程
-        {
-            delete [] m_threads;
+            shutdown(i);
             throw std::exception();
         }
     }
@@ -67,24 +67,31 @@ threadpool<T>::threadpool(int thread_number, int max_requests) :
 template<typename T>
 threadpool<T>::~threadpool()
 {
-    delete [] m_threads;
-    // 以结束工作线程
+    shutdown(m_thread_number);
+}
+
+template<typename T>
+void threadpool<T>::shutdown(int started)
+{
+    // 以结束工作线程，等待正在处理的任务完成
     m_stop = true;
+    m_queuestat.notify_all();
+    for (int i = 0; i < started; ++i)
+    {
+        pthread_join(m_threads[i], NULL);
+    }
+    delete [] m_threads;
 }
 
 template<typename T>
 bool threadpool<T>::append(T* request)
 {
-    m_queuelocker.lock();
-    if (m_workqueue.size() > m_max_requests)
+    if (!m_workqueue.push(request))     // 队列已满
     {
-        m_queuelocker.unlock();
         return false;
     }
-    m_workqueue.push_back(request);
-    m_queuelocker.unlock();
-    // 通知工作线程有任务
-    m_queuestat.post();
+    // 通知工作线程有任务，没有线程等待时不进行系统调用
+    m_queuestat.notify();
     return true;
 }
 
@@ -101,16 +108,28 @@ void threadpool<T>::run()
 {
     while (!m_stop)
     {
-        m_queuestat.wait();     // 等待有任务才去取得锁
-        m_queuelocker.lock();
-        if (m_workqueue.empty())
+        T* request = nullptr;
+        if (!m_workqueue.pop(request))
         {
-            m_queuelocker.unlock();
-            continue;
+            // 队列为空，准备等待后再检查一次，避免错过通知
+            unsigned key = m_queuestat.prepare_wait();
+            if (m_workqueue.pop(request))
+            {
+                m_queuestat.cancel_wait();
+            }
+            else
+            {
+                if (!m_stop)
+                {
+                    m_queuestat.wait(key);
+                }
+                else
+                {
+                    m_queuestat.cancel_wait();
+                }
+                continue;
+            }
         }
-        T* request = m_workqueue.front();
-        m_workqueue.pop_front();
-        m_queuelocker.unlock();
         if (!request)
         {
             continue;
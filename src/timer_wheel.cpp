@@ -0,0 +1,195 @@
+#include "timer_wheel.h"
+
+static const unsigned FIRST_TICK = 16;  // 起始tick，与特殊值区分
+
+thread_local timer_wheel* timer_wheel::t_current = nullptr;
+
+timer_wheel::timer_wheel(struct event_base* base, timeout_func cb, detach_func detach)
+    : m_now(FIRST_TICK), m_cancelled(nullptr), m_cb(cb), m_detach(detach), m_tick_ev(nullptr)
+{
+    for (int i = 0; i < SLOT_COUNT; ++i)
+    {
+        m_slots[i].prev = m_slots + i;
+        m_slots[i].next = m_slots + i;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &m_start);
+    if (base != nullptr)
+    {
+        m_tick_ev = event_new(base, -1, EV_PERSIST, tick_cb, this);
+        struct timeval tv = { 1, 0 };
+        event_add(m_tick_ev, &tv);
+    }
+}
+
+timer_wheel::~timer_wheel()
+{
+    if (m_tick_ev != nullptr)
+    {
+        event_free(m_tick_ev);
+    }
+}
+
+unsigned timer_wheel::after(int seconds) const
+{
+    return seconds > 0 ? now() + seconds : TIMER_NEVER;
+}
+
+void timer_wheel::unlink(timer_node* node)
+{
+    node->prev->next = node->next;
+    node->next->prev = node->prev;
+    node->prev = nullptr;
+    node->next = nullptr;
+}
+
+void timer_wheel::link(timer_node* node, unsigned slot)
+{
+    timer_node* head = m_slots + (slot & SLOT_MASK);
+    node->prev = head->prev;
+    node->next = head;
+    head->prev->next = node;
+    head->prev = node;
+}
+
+void timer_wheel::detach(timer_node* node)
+{
+    if (m_detach)
+    {
+        m_detach(node->data);
+    }
+}
+
+bool timer_wheel::schedule(timer_node* node, unsigned expire)
+{
+    node->expire.store(expire, std::memory_order_relaxed);
+    bool attached = (node->prev == nullptr);
+    if (!attached)
+    {
+        unlink(node);
+    }
+    if (expire == TIMER_OFF)
+    {
+        if (!attached)
+        {
+            detach(node);
+        }
+        return false;
+    }
+    unsigned t = now();
+    if (expire == TIMER_BUSY)
+    {
+        link(node, t + 1);
+    }
+    else if (expire == TIMER_NEVER)
+    {
+        link(node, t);      // 当前槽已处理过，转一圈后再检查
+    }
+    else
+    {
+        // 已过期的节点在下一个tick处理
+        link(node, ((int)(expire - t) > 0) ? expire : t + 1);
+    }
+    return attached;
+}
+
+void timer_wheel::cancel(timer_node* node)
+{
+    node->expire.store(TIMER_OFF, std::memory_order_relaxed);
+    timer_node* head = m_cancelled.load(std::memory_order_relaxed);
+    do
+    {
+        node->cancel_next = head;
+    } while (!m_cancelled.compare_exchange_weak(head, node, std::memory_order_release, std::memory_order_relaxed));
+}
+
+void timer_wheel::drain_cancelled(unsigned t)
+{
+    timer_node* node = m_cancelled.exchange(nullptr, std::memory_order_acquire);
+    while (node)
+    {
+        timer_node* next = node->cancel_next;
+        // 节点仍在时间轮中且未被重新设置，移到下一个tick的槽，由advance()移出并调用detach
+        if (node->prev && node->expire.load(std::memory_order_relaxed) == TIMER_OFF)
+        {
+            unlink(node);
+            link(node, t + 1);
+        }
+        detach(node);   // 释放cancel()的调用者持有的引用，之后不能再访问节点
+        node = next;
+    }
+}
+
+/**
+ * 前进一个tick：取下当前槽的全部节点，到期的调用回调函数，其余按expire放回对应的槽
+*/
+void timer_wheel::advance()
+{
+    unsigned t = m_now.load(std::memory_order_relaxed) + 1;
+    m_now.store(t, std::memory_order_relaxed);
+    drain_cancelled(t);
+
+    // 先把整个槽移到局部链表，避免放回同一槽的节点在本次被重复处理
+    timer_node pending;
+    timer_node* head = m_slots + (t & SLOT_MASK);
+    if (head->next == head)
+    {
+        return;
+    }
+    pending.next = head->next;
+    pending.prev = head->prev;
+    pending.next->prev = &pending;
+    pending.prev->next = &pending;
+    head->next = head;
+    head->prev = head;
+
+    while (pending.next != &pending)
+    {
+        timer_node* node = pending.next;
+        unlink(node);
+        unsigned expire = node->expire.load(std::memory_order_relaxed);
+        if (expire == TIMER_OFF)
+        {
+            detach(node);
+            continue;
+        }
+        if (expire == TIMER_BUSY)
+        {
+            link(node, t + 1);
+        }
+        else if (expire == TIMER_NEVER)
+        {
+            link(node, t);
+        }
+        else if ((int)(expire - t) <= 0)
+        {
+            // 回调函数推迟处理时不修改expire，其他线程此时设置的新到期时间仍然有效
+            if (!m_cb(node->data))
+            {
+                link(node, t + 1);
+            }
+            else
+            {
+                detach(node);
+            }
+        }
+        else
+        {
+            link(node, expire);     // 到期时间被推后，或者还没到它所在的那一圈
+        }
+    }
+}
+
+/**
+ * 定时事件回调函数，事件循环繁忙导致定时事件延迟时一次处理多个tick
+*/
+void timer_wheel::tick_cb(int fd, short events, void* arg)
+{
+    timer_wheel* wheel = (timer_wheel*)arg;
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    unsigned target = FIRST_TICK + (unsigned)(ts.tv_sec - wheel->m_start.tv_sec);
+    while ((int)(target - wheel->now()) > 0)
+    {
+        wheel->advance();
+    }
+}
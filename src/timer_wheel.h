@@ -0,0 +1,79 @@
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H
+
+#include <time.h>
+#include <atomic>
+#include <event.h>
+
+/**
+ * 定时器节点，嵌入在被计时的对象中
+ * expire为到期的tick，可以由任意线程修改（延迟生效），链表指针只由时间轮所在的事件循环线程访问
+*/
+struct timer_node
+{
+    timer_node() : prev(nullptr), next(nullptr), cancel_next(nullptr), expire(0), data(nullptr) {}
+
+    timer_node* prev;
+    timer_node* next;
+    timer_node* cancel_next;    // 其他线程cancel()的节点组成的链表
+    std::atomic<unsigned> expire;   // 到期的tick或下面的特殊值
+    void* data;     // 到期时传给回调函数的参数
+};
+
+/**
+ * 哈希时间轮，每个event_base一个，由该event_base上每秒触发一次的定时事件驱动
+ * 节点按到期tick散列到槽中，修改到期时间和每个tick的处理都是O(1)，与定时器数量无关。
+ * 事件循环线程通过schedule()修改到期时间并立即移动节点；其他线程只修改节点的expire，
+ * 节点在所在槽被处理时移到新的槽中，因此其他线程只应在节点处于TIMER_BUSY时修改expire；
+ * 其他线程关闭对象时调用cancel()，节点可能在TIMER_NEVER或较远的槽中，下一个tick把它移到再下一个tick的槽。
+ * 节点离开时间轮（TIMER_OFF被移出或回调函数已处理）时调用detach回调，嵌入节点的对象在此之前不能被复用
+*/
+class timer_wheel
+{
+public:
+    typedef bool (*timeout_func)(void* data);  // 返回false表示暂时不能处理，下一个tick再次回调
+    typedef void (*detach_func)(void* data);    // 节点已移出时间轮
+
+    static const unsigned TIMER_OFF = 0;    // 对象已关闭，节点在下次处理时移出时间轮
+    static const unsigned TIMER_BUSY = 1;   // 对象正由其他线程处理，暂不计时，每个tick检查一次
+    static const unsigned TIMER_NEVER = 2;  // 不超时，每转一圈检查一次
+
+public:
+    timer_wheel(struct event_base* base, timeout_func cb, detach_func detach = nullptr);
+    ~timer_wheel();
+    unsigned now() const { return m_now.load(std::memory_order_relaxed); }  // 当前tick，可由任意线程调用
+    void bind_thread() { t_current = this; }    // 由事件循环线程在开始循环前调用
+    bool in_loop() const { return t_current == this; }  // 当前线程是否为时间轮所在的事件循环线程
+    unsigned after(int seconds) const;  // seconds秒后到期的tick，seconds不大于0时为TIMER_NEVER
+    // 设置到期时间并移到对应的槽，只能由事件循环线程调用；返回true表示节点原来不在时间轮中
+    bool schedule(timer_node* node, unsigned expire);
+    // 由其他线程把节点设为TIMER_OFF，两个tick内移出时间轮；调用者为此持有一个引用，处理后通过detach回调释放
+    void cancel(timer_node* node);
+    void advance();     // 前进一个tick，处理到期的节点
+
+private:
+    timer_wheel(const timer_wheel&);
+    timer_wheel& operator=(const timer_wheel&);
+
+    static const int SLOT_BITS = 9;     // 512个槽，每个槽1秒
+    static const int SLOT_COUNT = 1 << SLOT_BITS;
+    static const unsigned SLOT_MASK = SLOT_COUNT - 1;
+
+    static void tick_cb(int fd, short events, void* arg);  // 每秒触发，追赶到当前时间
+    static void unlink(timer_node* node);
+    void link(timer_node* node, unsigned slot);
+    void detach(timer_node* node);
+    void drain_cancelled(unsigned t);   // 把cancel()的节点移到tick t+1的槽
+
+private:
+    static thread_local timer_wheel* t_current;     // 当前线程运行的事件循环的时间轮
+    timer_node m_slots[SLOT_COUNT];     // 每个槽是以哨兵节点为头的双向循环链表
+    std::atomic<unsigned> m_now;
+    std::atomic<timer_node*> m_cancelled;   // cancel()的节点，由事件循环线程每个tick取出
+    timeout_func m_cb;
+    detach_func m_detach;
+    struct timespec m_start;    // 启动时间，据此计算应处理到的tick
+    struct event* m_tick_ev;
+};
+
+#endif
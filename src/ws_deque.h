@@ -0,0 +1,138 @@
+#ifndef WS_DEQUE_H
+#define WS_DEQUE_H
+
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+
+/**
+ * Chase-Lev工作窃取双端队列（固定容量）
+ * 只有所属线程可以调用push()/pop()操作底部，其他线程通过steal()从顶部窃取，
+ * 内存序参照Lê等人的弱内存模型版本
+*/
+template<typename T>
+class ws_deque
+{
+public:
+    explicit ws_deque(size_t capacity);
+    ~ws_deque();
+    bool push(T* item);     // 所属线程压入底部，已满返回false
+    T* pop();               // 所属线程从底部弹出，为空返回nullptr
+    T* steal();             // 其他线程从顶部窃取，为空或竞争失败返回nullptr
+    bool empty() const;
+    size_t size() const;    // 元素个数的近似值
+
+private:
+    ws_deque(const ws_deque&);
+    ws_deque& operator=(const ws_deque&);
+
+    static const size_t CACHELINE_SIZE = 64;
+
+private:
+    std::atomic<T*>* m_buffer;
+    int64_t m_mask;
+    char m_pad0[CACHELINE_SIZE];
+    std::atomic<int64_t> m_top;     // 窃取端
+    char m_pad1[CACHELINE_SIZE];
+    std::atomic<int64_t> m_bottom;  // 所属线程端
+    char m_pad2[CACHELINE_SIZE];
+};
+
+template<typename T>
+ws_deque<T>::ws_deque(size_t capacity) : m_buffer(nullptr), m_mask(0), m_top(0), m_bottom(0)
+{
+    size_t size = 2;
+    while (size < capacity)
+    {
+        size <<= 1;
+    }
+    m_buffer = new std::atomic<T*>[size];
+    for (size_t i = 0; i < size; ++i)
+    {
+        m_buffer[i].store(nullptr, std::memory_order_relaxed);
+    }
+    m_mask = (int64_t)size - 1;
+}
+
+template<typename T>
+ws_deque<T>::~ws_deque()
+{
+    delete [] m_buffer;
+}
+
+template<typename T>
+bool ws_deque<T>::push(T* item)
+{
+    int64_t b = m_bottom.load(std::memory_order_relaxed);
+    int64_t t = m_top.load(std::memory_order_acquire);
+    if (b - t > m_mask)
+    {
+        return false;
+    }
+    m_buffer[b & m_mask].store(item, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    m_bottom.store(b + 1, std::memory_order_relaxed);
+    return true;
+}
+
+template<typename T>
+T* ws_deque<T>::pop()
+{
+    int64_t b = m_bottom.load(std::memory_order_relaxed) - 1;
+    m_bottom.store(b, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t t = m_top.load(std::memory_order_relaxed);
+    if (t > b)      // 队列为空
+    {
+        m_bottom.store(b + 1, std::memory_order_relaxed);
+        return nullptr;
+    }
+
+    T* item = m_buffer[b & m_mask].load(std::memory_order_relaxed);
+    if (t == b)     // 最后一个元素，与窃取者竞争
+    {
+        if (!m_top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+        {
+            item = nullptr;
+        }
+        m_bottom.store(b + 1, std::memory_order_relaxed);
+    }
+    return item;
+}
+
+template<typename T>
+T* ws_deque<T>::steal()
+{
+    int64_t t = m_top.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t b = m_bottom.load(std::memory_order_acquire);
+    if (t >= b)
+    {
+        return nullptr;
+    }
+
+    T* item = m_buffer[t & m_mask].load(std::memory_order_relaxed);
+    if (!m_top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+    {
+        return nullptr;
+    }
+    return item;
+}
+
+template<typename T>
+bool ws_deque<T>::empty() const
+{
+    int64_t b = m_bottom.load(std::memory_order_relaxed);
+    int64_t t = m_top.load(std::memory_order_relaxed);
+    return t >= b;
+}
+
+template<typename T>
+size_t ws_deque<T>::size() const
+{
+    int64_t b = m_bottom.load(std::memory_order_relaxed);
+    int64_t t = m_top.load(std::memory_order_relaxed);
+    return b > t ? (size_t)(b - t) : 0;
+}
+
+#endif
@@ -0,0 +1,240 @@
+#ifndef WS_THREADPOOL_H
+#define WS_THREADPOOL_H
+
+#include <cstdio>
+#include <cstdlib>
+#include <atomic>
+#include <exception>
+#include <pthread.h>
+#include "locker.h"
+#include "logger.h"
+#include "mpmc_queue.h"
+#include "ws_deque.h"
+
+/**
+ * 工作窃取线程池类，接口与threadpool相同
+ * 每个工作线程拥有一个收件队列和一个Chase-Lev双端队列：主线程轮流把任务投递到各线程的收件队列；
+ * 工作线程把收件队列中的任务批量移入本地双端队列处理，空闲时从其他线程窃取
+*/
+template<typename T>
+class ws_threadpool
+{
+public:
+    ws_threadpool(int thread_number = 8, int max_requests = 10000);
+    ~ws_threadpool();
+    bool append(T* request);    // 往请求队列中添加任务，由主线程调用
+    size_t queue_size() const;  // 各线程收件队列和本地队列中等待的任务数的近似值
+
+private:
+    static const int BATCH_SIZE = 32;   // 每次从收件队列移入本地队列的最大任务数
+    static const int DEQUE_SIZE = BATCH_SIZE * 2;   // 本地队列容量，本地队列为空时才批量移入，一批总能放下
+    static_assert(DEQUE_SIZE >= BATCH_SIZE, "local deque must hold a whole batch");
+
+    // 每个工作线程的上下文
+    struct worker_ctx
+    {
+        ws_threadpool* pool;
+        int index;
+        mpmc_queue<T*>* inbox;  // 收件队列，主线程写入
+        ws_deque<T>* deque;     // 本地双端队列，只有本线程压入
+        unsigned seed;          // 选择窃取对象的随机数种子
+    };
+
+    static void* worker(void* arg);  // 线程的工作函数需要为静态函数（全局函数）
+    void run(worker_ctx* ctx);  // 工作线程实际运行的函数
+    T* take(worker_ctx* ctx);   // 依次从本地队列、收件队列、其他线程获取任务
+    void shutdown(int started); // 结束并回收前started个工作线程，释放所有工作线程上下文
+
+private:
+    int m_thread_number;    // 线程池中的线程数
+    int m_max_requests;     // 请求队列中允许的最大请求数
+    pthread_t* m_threads;   // 描述线程池的数组，大小为m_thread_number
+    worker_ctx* m_workers;  // 工作线程上下文数组，大小为m_thread_number
+    eventcount m_queuestat;    // 所有队列为空时工作线程在此等待
+    std::atomic<unsigned> m_next;   // 下一个投递任务的线程序号，轮流递增
+    std::atomic<bool> m_stop;   // 是否结束线程
+};
+
+template<typename T>
+ws_threadpool<T>::ws_threadpool(int thread_number, int max_requests) :
+        m_thread_number(thread_number), m_max_requests(max_requests), m_threads(nullptr),
+        m_workers(nullptr), m_next(0), m_stop(false)
+{
+    if(( thread_number <= 0) || (max_requests <= 0))
+    {
+        throw std::exception();
+    }
+
+    m_threads = new pthread_t[m_thread_number];
+    m_workers = new worker_ctx[m_thread_number];
+    int inbox_size = max_requests / thread_number;
+    for (int i = 0; i < thread_number; ++i)
+    {
+        m_workers[i].pool = this;
+        m_workers[i].index = i;
+        m_workers[i].inbox = new mpmc_queue<T*>(inbox_size);
+        m_workers[i].deque = new ws_deque<T>(DEQUE_SIZE);
+        m_workers[i].seed = i + 1;
+    }
+
+    // 创建线程池
+    for (int i = 0; i < thread_number; ++i)
+    {
+        LOG_DEBUG("create the %dth thread", i);
+        // 工作线程不设置为脱离，析构时等待其退出后再释放各线程的队列
+        if(pthread_create(m_threads + i, NULL, worker, m_workers + i) != 0 )
+        {
+            shutdown(i);
+            throw std::exception();
+        }
+    }
+}
+
+template<typename T>
+ws_threadpool<T>::~ws_threadpool()
+{
+    shutdown(m_thread_number);
+}
+
+template<typename T>
+void ws_threadpool<T>::shutdown(int started)
+{
+    // 以结束工作线程，等待正在处理的任务完成
+    m_stop = true;
+    m_queuestat.notify_all();
+    for (int i = 0; i < started; ++i)
+    {
+        pthread_join(m_threads[i], NULL);
+    }
+
+    for (int i = 0; i < m_thread_number; ++i)
+    {
+        delete m_workers[i].inbox;
+        delete m_workers[i].deque;
+    }
+    delete [] m_workers;
+    delete [] m_threads;
+}
+
+template<typename T>
+bool ws_threadpool<T>::append(T* request)
+{
+    // 轮流选择目标线程，使任务均匀分布到各收件队列
+    int index = (int)(m_next.fetch_add(1, std::memory_order_relaxed) % m_thread_number);
+    for (int i = 0; i < m_thread_number; ++i)
+    {
+        // 目标线程的收件队列已满时依次尝试下一个线程
+        if (m_workers[(index + i) % m_thread_number].inbox->push(request))
+        {
+            m_queuestat.notify();
+            return true;
+        }
+    }
+    return false;
+}
+
+template<typename T>
+size_t ws_threadpool<T>::queue_size() const
+{
+    size_t size = 0;
+    for (int i = 0; i < m_thread_number; ++i)
+    {
+        size += m_workers[i].inbox->size() + m_workers[i].deque->size();
+    }
+    return size;
+}
+
+template<typename T>
+void* ws_threadpool<T>::worker(void* arg)
+{
+    worker_ctx* ctx = (worker_ctx*)arg;
+    ctx->pool->run(ctx);
+    return ctx->pool;
+}
+
+template<typename T>
+T* ws_threadpool<T>::take(worker_ctx* ctx)
+{
+    T* request = ctx->deque->pop();
+    if (request)
+    {
+        return request;
+    }
+
+    // 本地队列为空，从收件队列批量移入，第一个直接处理
+    T* item = nullptr;
+    int moved = 0;
+    while (moved < BATCH_SIZE && ctx->inbox->pop(item))
+    {
+        if (!request)
+        {
+            request = item;
+        }
+        else if (!ctx->deque->push(item))
+        {
+            // 容量足够时不会发生，否则任务被丢弃，连接的引用永远不会释放，所以直接处理
+            item->process();
+        }
+        ++moved;
+    }
+    if (request)
+    {
+        if (moved > 1)  // 本地还有剩余任务，唤醒空闲线程来窃取
+        {
+            m_queuestat.notify();
+        }
+        return request;
+    }
+
+    // 从随机选择的线程开始窃取，先窃取本地队列，再窃取收件队列
+    int start = rand_r(&ctx->seed) % m_thread_number;
+    for (int i = 0; i < m_thread_number; ++i)
+    {
+        worker_ctx* victim = m_workers + (start + i) % m_thread_number;
+        if (victim == ctx)
+        {
+            continue;
+        }
+        request = victim->deque->steal();
+        if (request || victim->inbox->pop(request))
+        {
+            return request;
+        }
+    }
+    return nullptr;
+}
+
+template<typename T>
+void ws_threadpool<T>::run(worker_ctx* ctx)
+{
+    while (!m_stop)
+    {
+        T* request = take(ctx);
+        if (!request)
+        {
+            // 所有队列均为空，准备等待后再检查一次，避免错过通知
+            unsigned key = m_queuestat.prepare_wait();
+            request = take(ctx);
+            if (request)
+            {
+                m_queuestat.cancel_wait();
+            }
+            else
+            {
+                if (!m_stop)
+                {
+                    m_queuestat.wait(key);
+                }
+                else
+                {
+                    m_queuestat.cancel_wait();
+                }
+                continue;
+            }
+        }
+        // 处理任务
+        request->process();
+    }
+}
+
+#endif